@@ -0,0 +1,8 @@
+echo Building stub-data-link
+cd stub-data-link
+g++ -o stub-data-link -I ../radio-panel \
+    stub-data-link.cpp \
+    ../radio-panel/simvarDefs.cpp \
+    ../radio-panel/framecodec.cpp \
+    ../radio-panel/framediff.cpp || exit
+echo Done
@@ -1,13 +1,29 @@
 echo Building radio-panel
 cd radio-panel
-g++ -o radio-panel -I . \
+
+# ARMv7 and later always have NEON but 32 bit Raspberry Pi OS builds
+# for ARMv6 (Pi Zero, no NEON) unless told otherwise. 64 bit enables
+# it anyway. Build on the Pi that runs the panel.
+SIMD=
+case $(uname -m) in
+    armv7l|armv8l)
+        SIMD="-march=armv7-a -mfpu=neon-vfpv4 -mfloat-abi=hard"
+        ;;
+esac
+
+g++ -o radio-panel -I . $SIMD \
     settings.cpp \
     simvarDefs.cpp \
     simvars.cpp \
+    linkstats.cpp \
+    framecodec.cpp \
+    framediff.cpp \
+    capture.cpp \
+    sharedvars.cpp \
     globals.cpp \
     gpioctrl.cpp \
     sevensegment.cpp \
     radio.cpp \
     radio-panel.cpp \
-    -lwiringPi -lpthread || exit
+    -lwiringPi -lpthread -lrt || exit
 echo Done
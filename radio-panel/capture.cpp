@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture.h"
+
+capture::~capture()
+{
+    if (outf) {
+        fclose(outf);
+    }
+
+    if (mapped) {
+        munmap(mapped, mappedSize);
+    }
+}
+
+/// <summary>
+/// Open a capture file for appending. The header is only written
+/// if the file is new and must match if it isn't.
+/// </summary>
+void capture::openWrite(const char* filename, CaptureHeader* header)
+{
+    if ((outf = fopen(filename, "a+b")) == NULL) {
+        printf("Failed to open capture file %s\n", filename);
+        exit(1);
+    }
+
+    memcpy(header->magic, CaptureMagic, sizeof(header->magic));
+
+    fseek(outf, 0, SEEK_END);
+    if (ftell(outf) == 0) {
+        fwrite(header, sizeof(CaptureHeader), 1, outf);
+        fflush(outf);
+        return;
+    }
+
+    CaptureHeader existing;
+    fseek(outf, 0, SEEK_SET);
+    if (fread(&existing, sizeof(existing), 1, outf) != 1 || memcmp(&existing, header, sizeof(existing)) != 0) {
+        printf("Capture file %s was captured with different SimVars\n", filename);
+        exit(1);
+    }
+    fseek(outf, 0, SEEK_END);
+}
+
+/// <summary>
+/// Append a record. Safe to call from any thread as the whole record
+/// is written with a single (locked) fwrite.
+/// </summary>
+void capture::record(long long timeNs, int type, const void* data1, int size1, const void* data2, int size2)
+{
+    char buf[sizeof(CaptureRecord) + 16384];
+    CaptureRecord* rec = (CaptureRecord*)buf;
+    int paddedSize = (size1 + size2 + 7) & ~7;
+
+    if (!outf || sizeof(CaptureRecord) + paddedSize > sizeof(buf)) {
+        return;
+    }
+
+    rec->timeNs = timeNs;
+    rec->type = type;
+    rec->size = size1 + size2;
+
+    char* data = buf + sizeof(CaptureRecord);
+    memcpy(data, data1, size1);
+    if (size2 > 0) {
+        memcpy(data + size1, data2, size2);
+    }
+    memset(data + rec->size, 0, paddedSize - rec->size);
+
+    fwrite(buf, sizeof(CaptureRecord) + paddedSize, 1, outf);
+}
+
+/// <summary>
+/// Map a capture file for replay and return its header
+/// </summary>
+CaptureHeader* capture::openRead(const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+
+    if (fd == -1 || fstat(fd, &info) != 0) {
+        printf("Capture file %s not found\n", filename);
+        exit(1);
+    }
+
+    mappedSize = info.st_size;
+    if (mappedSize < (long)sizeof(CaptureHeader)) {
+        printf("Capture file %s is empty\n", filename);
+        exit(1);
+    }
+
+    mapped = (char*)mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        printf("Failed to map capture file %s\n", filename);
+        exit(1);
+    }
+
+    CaptureHeader* header = (CaptureHeader*)mapped;
+    if (memcmp(header->magic, CaptureMagic, sizeof(header->magic)) != 0) {
+        printf("%s is not a capture file\n", filename);
+        exit(1);
+    }
+
+    readPos = sizeof(CaptureHeader);
+    return header;
+}
+
+/// <summary>
+/// Returns the next record or NULL at the end of the capture
+/// (or if the last record was only partly written).
+/// </summary>
+CaptureRecord* capture::next(char** data)
+{
+    if (mappedSize - readPos < (long)sizeof(CaptureRecord)) {
+        return NULL;
+    }
+
+    CaptureRecord* rec = (CaptureRecord*)(mapped + readPos);
+    long paddedSize = ((long)rec->size + 7) & ~7L;
+    if (rec->size < 0 || mappedSize - readPos - (long)sizeof(CaptureRecord) < paddedSize) {
+        return NULL;
+    }
+
+    *data = mapped + readPos + sizeof(CaptureRecord);
+    readPos += sizeof(CaptureRecord) + paddedSize;
+    return rec;
+}
@@ -0,0 +1,49 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdio.h>
+#include "simvarDefs.h"
+
+/// <summary>
+/// A capture file is a header followed by records. Each record is a
+/// CaptureRecord followed by its data, padded to 8 bytes so a whole
+/// capture can be mmapped and walked in place.
+/// </summary>
+const char CaptureMagic[8] = "RPCAP01";
+
+struct CaptureHeader {
+    char magic[8];
+    int simVarsSize;
+    int dataSize;
+    unsigned int fields[FieldWords];
+};
+
+enum CaptureType {
+    CAPTURE_RECEIVED,   // Datagram received from the data link
+    CAPTURE_WRITTEN,    // WriteBatch sent to the data link
+    CAPTURE_FIELDS      // Fields now in use (changed since the header)
+};
+
+struct CaptureRecord {
+    long long timeNs;   // Monotonic time
+    int type;
+    int size;
+};
+
+class capture
+{
+private:
+    FILE* outf = NULL;
+    char* mapped = NULL;
+    long mappedSize = 0;
+    long readPos = 0;
+
+public:
+    ~capture();
+    void openWrite(const char* filename, CaptureHeader* header);
+    void record(long long timeNs, int type, const void* data1, int size1, const void* data2 = NULL, int size2 = 0);
+    CaptureHeader* openRead(const char* filename);
+    CaptureRecord* next(char** data);
+};
+
+#endif // _CAPTURE_H_
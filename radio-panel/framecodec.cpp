@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "framecodec.h"
+
+/// <summary>
+/// Build the table of all fields. Field 0 is connected and field n
+/// is SimVarSchema[n - 1]. Returns the number of fields.
+/// </summary>
+int fieldTable(FieldDef* fields)
+{
+    fields[0].offset = 0;
+    fields[0].size = sizeof(double);
+    fields[0].codec = CODEC_BIT;
+
+    int field = 1;
+    for (; SimVarSchema[field - 1].name != NULL && field < MaxFields; field++) {
+        const char* units = SimVarSchema[field - 1].units;
+
+        fields[field].offset = SimVarSchema[field - 1].offset;
+        fields[field].size = SimVarSchema[field - 1].size;
+
+        if (strcmp(units, "string32") == 0) {
+            fields[field].codec = CODEC_STRING;
+        }
+        else if (strcmp(units, "bool") == 0) {
+            fields[field].codec = CODEC_BIT;
+        }
+        else if (strcmp(units, "enum") == 0) {
+            fields[field].codec = CODEC_BYTE;
+        }
+        else if (strcmp(units, "mask") == 0 || strcmp(units, "bco16") == 0) {
+            fields[field].codec = CODEC_WORD;
+        }
+        else if (strcmp(units, "mhz") == 0) {
+            fields[field].codec = CODEC_MHZ;
+        }
+        else if (strcmp(units, "khz") == 0) {
+            fields[field].codec = CODEC_KHZ;
+        }
+        else {
+            fields[field].codec = CODEC_DOUBLE;
+        }
+    }
+
+    return field;
+}
+
+/// <summary>
+/// Select the fields set in the subscription bitmap
+/// </summary>
+void framecodec::subscribe(const unsigned int* fieldBits)
+{
+    allCount = fieldTable(allFields);
+
+    fieldCount = 0;
+    bitCount = 0;
+    rawSize = 0;
+    memset(slotKind, SLOT_NONE, sizeof(slotKind));
+    for (int field = 0; field < allCount; field++) {
+        subscribed[field] = (fieldBits[field / 32] & (1u << (field % 32))) != 0;
+        if (subscribed[field]) {
+            slotKind[allFields[field].offset / 8] = (allFields[field].codec == CODEC_STRING) ? SLOT_STRING : SLOT_DOUBLE;
+            fields[fieldCount] = field;
+            if (allFields[field].codec == CODEC_BIT || allFields[field].codec == CODEC_STRING) {
+                bitCount++;
+            }
+            rawSize += allFields[field].size;
+            fieldCount++;
+        }
+    }
+}
+
+/// <summary>
+/// FNV-1a hash of the subscribed strings. Lets the server leave out
+/// strings the client already has without tracking client state.
+/// </summary>
+unsigned int framecodec::stringHash(const char* simVarsPtr)
+{
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < fieldCount; i++) {
+        FieldDef* field = &allFields[fields[i]];
+        if (field->codec == CODEC_STRING) {
+            const char* str = simVarsPtr + field->offset;
+            for (int j = 0; j < 32 && str[j] != '\0'; j++) {
+                hash = (hash ^ (unsigned char)str[j]) * 16777619u;
+            }
+            hash = (hash ^ 0xff) * 16777619u;
+        }
+    }
+
+    return hash;
+}
+
+void writeVarint(char** pos, unsigned int val)
+{
+    while (val >= 0x80) {
+        *(*pos)++ = (char)(val | 0x80);
+        val >>= 7;
+    }
+    *(*pos)++ = (char)val;
+}
+
+bool readVarint(const char** pos, const char* end, unsigned int* val)
+{
+    *val = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        if (*pos == end) {
+            return false;
+        }
+        unsigned char byte = *(*pos)++;
+        *val |= (unsigned int)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Write a field value in the size its codec needs. Bools take a
+/// byte and strings are length prefixed. Returns false if the value
+/// doesn't fit the codec.
+/// </summary>
+bool encodeValue(char** pos, const FieldDef* field, const char* fieldPtr)
+{
+    double val;
+
+    if (field->codec == CODEC_STRING) {
+        int len = strnlen(fieldPtr, 31);
+        writeVarint(pos, len);
+        memcpy(*pos, fieldPtr, len);
+        *pos += len;
+        return true;
+    }
+
+    memcpy(&val, fieldPtr, sizeof(double));
+
+    switch (field->codec) {
+    case CODEC_BIT:
+    case CODEC_BYTE:
+        if (val < 0 || val > UINT8_MAX || val != (uint8_t)val || (field->codec == CODEC_BIT && val > 1)) {
+            return false;
+        }
+        *(*pos)++ = (uint8_t)val;
+        return true;
+
+    case CODEC_WORD:
+    {
+        if (val < 0 || val > UINT16_MAX || val != (uint16_t)val) {
+            return false;
+        }
+        uint16_t word = (uint16_t)val;
+        memcpy(*pos, &word, sizeof(word));
+        *pos += sizeof(word);
+        return true;
+    }
+
+    case CODEC_MHZ:
+    case CODEC_KHZ:
+    {
+        double hz = round(val * (field->codec == CODEC_MHZ ? 1000000.0 : 1000.0));
+        if (hz < INT32_MIN || hz > INT32_MAX) {
+            return false;
+        }
+        int32_t freq = (int32_t)hz;
+        memcpy(*pos, &freq, sizeof(freq));
+        *pos += sizeof(freq);
+        return true;
+    }
+
+    default:
+        memcpy(*pos, fieldPtr, sizeof(double));
+        *pos += sizeof(double);
+        return true;
+    }
+}
+
+/// <summary>
+/// Read a field value written by encodeValue into SimVars.
+/// Returns false if the frame is too short.
+/// </summary>
+bool decodeValue(const char** pos, const char* end, const FieldDef* field, char* fieldPtr)
+{
+    double val;
+
+    switch (field->codec) {
+    case CODEC_STRING:
+    {
+        unsigned int len;
+        if (!readVarint(pos, end, &len) || len > 31 || end - *pos < (int)len) {
+            return false;
+        }
+        memcpy(fieldPtr, *pos, len);
+        memset(fieldPtr + len, 0, 32 - len);
+        *pos += len;
+        return true;
+    }
+
+    case CODEC_BIT:
+    case CODEC_BYTE:
+        if (end - *pos < 1) {
+            return false;
+        }
+        val = (uint8_t)*(*pos)++;
+        break;
+
+    case CODEC_WORD:
+    {
+        uint16_t word;
+        if (end - *pos < (int)sizeof(word)) {
+            return false;
+        }
+        memcpy(&word, *pos, sizeof(word));
+        *pos += sizeof(word);
+        val = word;
+        break;
+    }
+
+    case CODEC_MHZ:
+    case CODEC_KHZ:
+    {
+        int32_t freq;
+        if (end - *pos < (int)sizeof(freq)) {
+            return false;
+        }
+        memcpy(&freq, *pos, sizeof(freq));
+        *pos += sizeof(freq);
+        val = freq / (field->codec == CODEC_MHZ ? 1000000.0 : 1000.0);
+        break;
+    }
+
+    default:
+        if (end - *pos < (int)sizeof(double)) {
+            return false;
+        }
+        memcpy(&val, *pos, sizeof(double));
+        *pos += sizeof(double);
+        break;
+    }
+
+    memcpy(fieldPtr, &val, sizeof(double));
+    return true;
+}
+
+/// <summary>
+/// Encode the subscribed fields as a compact frame. Returns the frame
+/// size or -1 if a value doesn't fit its codec or the frame would be
+/// no smaller than raw data, in which case raw data should be sent.
+/// </summary>
+int framecodec::encode(char* frame, const char* simVarsPtr, unsigned int clientStringHash)
+{
+    bool sendStrings = (stringHash(simVarsPtr) != clientStringHash);
+    int bitBytes = (bitCount + 7) / 8;
+    int bit = 0;
+    char* pos = frame + bitBytes;
+
+    memset(frame, 0, bitBytes);
+
+    for (int i = 0; i < fieldCount; i++) {
+        FieldDef* field = &allFields[fields[i]];
+        const char* fieldPtr = simVarsPtr + field->offset;
+        double val;
+
+        switch (field->codec) {
+        case CODEC_BIT:
+            memcpy(&val, fieldPtr, sizeof(double));
+            if (val != 0 && val != 1) {
+                return -1;
+            }
+            if (val == 1) {
+                frame[bit / 8] |= 1 << (bit % 8);
+            }
+            bit++;
+            break;
+
+        case CODEC_STRING:
+            if (sendStrings) {
+                frame[bit / 8] |= 1 << (bit % 8);
+                memcpy(pos, fieldPtr, 32);
+                pos += 32;
+            }
+            bit++;
+            break;
+
+        default:
+            if (!encodeValue(&pos, field, fieldPtr)) {
+                return -1;
+            }
+            break;
+        }
+    }
+
+    int frameSize = pos - frame;
+    if (frameSize >= rawSize) {
+        return -1;
+    }
+
+    return frameSize;
+}
+
+/// <summary>
+/// Decode a compact frame into SimVars. Strings that weren't sent are
+/// copied from the previous frame. Returns false (leaving SimVars
+/// partly updated) if the frame is the wrong size.
+/// </summary>
+bool framecodec::decode(char* simVarsPtr, const char* frame, int frameSize, const char* prevVarsPtr)
+{
+    int bitBytes = (bitCount + 7) / 8;
+    int bit = 0;
+    const char* pos = frame + bitBytes;
+    const char* end = frame + frameSize;
+
+    if (frameSize < bitBytes) {
+        return false;
+    }
+
+    for (int i = 0; i < fieldCount; i++) {
+        FieldDef* field = &allFields[fields[i]];
+        char* fieldPtr = simVarsPtr + field->offset;
+
+        switch (field->codec) {
+        case CODEC_BIT:
+        {
+            double val = (frame[bit / 8] >> (bit % 8)) & 1;
+            memcpy(fieldPtr, &val, sizeof(double));
+            bit++;
+            break;
+        }
+
+        case CODEC_STRING:
+        {
+            bool present = (frame[bit / 8] >> (bit % 8)) & 1;
+            bit++;
+            if (!present) {
+                memcpy(fieldPtr, prevVarsPtr + field->offset, 32);
+            }
+            else if (end - pos < 32) {
+                return false;
+            }
+            else {
+                memcpy(fieldPtr, pos, 32);
+                fieldPtr[31] = '\0';
+                pos += 32;
+            }
+            break;
+        }
+
+        default:
+            if (!decodeValue(&pos, end, field, fieldPtr)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    return pos == end;
+}
+
+/// <summary>
+/// Encode the subscribed fields that differ between two frames as a
+/// compact delta. Changed fields are grouped into runs of adjacent
+/// fields, each written as the varint gap from the end of the previous
+/// run, a varint count and then the values. Returns the delta size or
+/// -1 if a value doesn't fit its codec.
+/// </summary>
+int framecodec::encodeDelta(char* delta, const char* simVarsPtr, const char* prevVarsPtr)
+{
+    char* pos = delta;
+    int runEnd = 0;
+
+    for (int i = 0; i < fieldCount; ) {
+        FieldDef* field = &allFields[fields[i]];
+        if (memcmp(simVarsPtr + field->offset, prevVarsPtr + field->offset, field->size) == 0) {
+            i++;
+            continue;
+        }
+
+        // Find the end of this run of changed (and subscribed) fields
+        int first = fields[i];
+        int count = 0;
+        while (i < fieldCount && fields[i] == first + count) {
+            field = &allFields[fields[i]];
+            if (memcmp(simVarsPtr + field->offset, prevVarsPtr + field->offset, field->size) == 0) {
+                break;
+            }
+            count++;
+            i++;
+        }
+
+        writeVarint(&pos, first - runEnd);
+        writeVarint(&pos, count);
+        for (int field = first; field < first + count; field++) {
+            if (!encodeValue(&pos, &allFields[field], simVarsPtr + allFields[field].offset)) {
+                return -1;
+            }
+        }
+        runEnd = first + count;
+    }
+
+    return pos - delta;
+}
+
+/// <summary>
+/// Apply a compact delta to SimVars. The delta is checked in full
+/// before anything is written so a malformed delta (returns false)
+/// leaves SimVars untouched.
+/// </summary>
+bool framecodec::decodeDelta(char* simVarsPtr, const char* delta, int deltaSize)
+{
+    return walkDelta(NULL, delta, deltaSize) && walkDelta(simVarsPtr, delta, deltaSize);
+}
+
+/// <summary>
+/// Decode a compact delta into SimVars or just check it is valid if
+/// simVarsPtr is NULL.
+/// </summary>
+bool framecodec::walkDelta(char* simVarsPtr, const char* delta, int deltaSize)
+{
+    const char* pos = delta;
+    const char* end = delta + deltaSize;
+    unsigned int field = 0;
+    char scratch[32];
+
+    while (pos < end) {
+        unsigned int gap;
+        unsigned int count;
+        if (!readVarint(&pos, end, &gap) || !readVarint(&pos, end, &count)) {
+            return false;
+        }
+
+        if (count == 0 || gap >= (unsigned int)allCount - field || count > allCount - field - gap) {
+            return false;
+        }
+        field += gap;
+
+        for (unsigned int last = field + count; field < last; field++) {
+            char* fieldPtr = simVarsPtr ? simVarsPtr + allFields[field].offset : scratch;
+            if (!subscribed[field] || !decodeValue(&pos, end, &allFields[field], fieldPtr)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Apply a raw delta (DeltaDouble and DeltaString records addressed by
+/// SimVars offset) to SimVars. Every record is checked against the
+/// subscribed layout first so nothing from the wire can write outside
+/// a subscribed field, then applied with no further checks. A
+/// malformed delta (returns false) leaves SimVars untouched.
+/// </summary>
+bool framecodec::decodeRawDelta(char* simVarsPtr, const char* delta, int deltaSize)
+{
+    const int StringFlag = 0x10000;
+    int pos = 0;
+    int offset;
+
+    while (pos < deltaSize) {
+        if (deltaSize - pos < (int)sizeof(DeltaDouble)) {
+            return false;
+        }
+
+        memcpy(&offset, delta + pos, sizeof(int));
+        bool isString = (offset & StringFlag) != 0;
+        unsigned int fieldOffset = offset & ~StringFlag;
+        int recordSize = isString ? sizeof(DeltaString) : sizeof(DeltaDouble);
+
+        if (fieldOffset >= sizeof(SimVars) || (fieldOffset & 7) != 0 || deltaSize - pos < recordSize) {
+            return false;
+        }
+
+        if (slotKind[fieldOffset / 8] != (isString ? SLOT_STRING : SLOT_DOUBLE)) {
+            return false;
+        }
+
+        if (isString && memchr(delta + pos + offsetof(DeltaString, data), '\0', 32) == NULL) {
+            return false;
+        }
+
+        pos += recordSize;
+    }
+
+    for (pos = 0; pos < deltaSize; ) {
+        memcpy(&offset, delta + pos, sizeof(int));
+        bool isString = (offset & StringFlag) != 0;
+        int dataPos = isString ? offsetof(DeltaString, data) : offsetof(DeltaDouble, data);
+        int dataSize = isString ? 32 : sizeof(double);
+
+        memcpy(simVarsPtr + (offset & ~StringFlag), delta + pos + dataPos, dataSize);
+        pos += isString ? sizeof(DeltaString) : sizeof(DeltaDouble);
+    }
+
+    return true;
+}
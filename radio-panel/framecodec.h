@@ -0,0 +1,75 @@
+#ifndef _FRAMECODEC_H_
+#define _FRAMECODEC_H_
+
+#include "simvarDefs.h"
+
+/// <summary>
+/// How a field travels in a compact frame. Chosen from the
+/// schema units so the encoding is entirely table-driven.
+/// </summary>
+enum FieldCodec {
+    CODEC_DOUBLE,   // 8 bytes, unchanged
+    CODEC_BIT,      // bool packed into the bit section
+    CODEC_BYTE,     // enum as uint8
+    CODEC_WORD,     // mask or bco16 as uint16
+    CODEC_MHZ,      // MHz as int32 Hz
+    CODEC_KHZ,      // kHz as int32 Hz
+    CODEC_STRING    // 32 chars, only sent if the client doesn't have it
+};
+
+struct FieldDef {
+    int offset;     // Offset into SimVars
+    int size;       // Size in SimVars
+    FieldCodec codec;
+};
+
+int fieldTable(FieldDef* fields);
+
+// What starts at each 8 byte slot of SimVars (for checking raw deltas)
+enum SlotKind {
+    SLOT_NONE,
+    SLOT_DOUBLE,
+    SLOT_STRING
+};
+
+/// <summary>
+/// Encodes and decodes compact frames for a field subscription.
+///
+/// A compact full frame starts with a bit section holding every bool
+/// field followed by a present flag for every string field (in field
+/// order, LSB first). The remaining fields follow in field order, each
+/// in the size its codec needs. A string is only present if the
+/// client's string hash (sent in the request) doesn't match.
+///
+/// A compact delta is a list of runs of adjacent changed fields (see
+/// encodeDelta). Bools take a byte and strings are length prefixed.
+///
+/// Deltas are checked in full before they are applied so a bad one
+/// never leaves SimVars half updated or writes outside a field.
+/// </summary>
+class framecodec
+{
+private:
+    FieldDef allFields[MaxFields];
+    bool subscribed[MaxFields];
+    int allCount = 0;
+    int fields[MaxFields];      // Subscribed field numbers
+    int fieldCount = 0;
+    int bitCount = 0;
+    int rawSize = 0;
+    unsigned char slotKind[sizeof(SimVars) / 8];
+
+public:
+    void subscribe(const unsigned int* fieldBits);
+    unsigned int stringHash(const char* simVarsPtr);
+    int encode(char* frame, const char* simVarsPtr, unsigned int clientStringHash);
+    bool decode(char* simVarsPtr, const char* frame, int frameSize, const char* prevVarsPtr);
+    int encodeDelta(char* delta, const char* simVarsPtr, const char* prevVarsPtr);
+    bool decodeDelta(char* simVarsPtr, const char* delta, int deltaSize);
+    bool decodeRawDelta(char* simVarsPtr, const char* delta, int deltaSize);
+
+private:
+    bool walkDelta(char* simVarsPtr, const char* delta, int deltaSize);
+};
+
+#endif // _FRAMECODEC_H_
@@ -0,0 +1,133 @@
+#include <string.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "framediff.h"
+
+inline void setSlot(unsigned int* slotBits, int slot)
+{
+    slotBits[slot / 32] |= 1u << (slot % 32);
+}
+
+/// <summary>
+/// Compare slots first to slots-1 one at a time
+/// </summary>
+inline bool diffEach(unsigned int* slotBits, const char* newPtr, const char* oldPtr, int firstSlot, int first, int slots)
+{
+    bool changed = false;
+
+    for (int i = first; i < slots; i++) {
+        uint64_t newVal;
+        uint64_t oldVal;
+        memcpy(&newVal, newPtr + i * 8, 8);
+        memcpy(&oldVal, oldPtr + i * 8, 8);
+        if (newVal != oldVal) {
+            changed = true;
+            setSlot(slotBits, firstSlot + i);
+        }
+    }
+
+    return changed;
+}
+
+/// <summary>
+/// Compare size bytes at offset in two SimVars and set the bit in
+/// slotBits for every 8 byte slot that differs. Returns false if
+/// nothing differs, so the caller can skip looking at slotBits.
+///
+/// Compares 4 slots at a time with AVX2, 2 at a time with SSE2 or
+/// NEON and one at a time otherwise. The common case of nothing
+/// changed is a single pass with one well predicted branch per step.
+/// </summary>
+bool diffSlots(unsigned int* slotBits, const char* simVarsPtr, const char* prevVarsPtr, int offset, int size)
+{
+    const char* newPtr = simVarsPtr + offset;
+    const char* oldPtr = prevVarsPtr + offset;
+    int firstSlot = offset / 8;
+    int slots = size / 8;
+    bool changed = false;
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 4 <= slots; i += 4) {
+        __m256i newVals = _mm256_loadu_si256((const __m256i*)(newPtr + i * 8));
+        __m256i oldVals = _mm256_loadu_si256((const __m256i*)(oldPtr + i * 8));
+        int same = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(newVals, oldVals)));
+        if (same != 0xf) {
+            changed = true;
+            for (unsigned int diff = ~same & 0xf; diff != 0; diff &= diff - 1) {
+                setSlot(slotBits, firstSlot + i + __builtin_ctz(diff));
+            }
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    for (; i + 2 <= slots; i += 2) {
+        __m128i newVals = _mm_loadu_si128((const __m128i*)(newPtr + i * 8));
+        __m128i oldVals = _mm_loadu_si128((const __m128i*)(oldPtr + i * 8));
+        int same = _mm_movemask_epi8(_mm_cmpeq_epi8(newVals, oldVals));
+        if (same != 0xffff) {
+            changed = true;
+            if ((same & 0xff) != 0xff) {
+                setSlot(slotBits, firstSlot + i);
+            }
+            if ((same & 0xff00) != 0xff00) {
+                setSlot(slotBits, firstSlot + i + 1);
+            }
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= slots; i += 2) {
+        uint8x16_t newVals = vld1q_u8((const uint8_t*)(newPtr + i * 8));
+        uint8x16_t oldVals = vld1q_u8((const uint8_t*)(oldPtr + i * 8));
+        uint64x2_t same = vreinterpretq_u64_u8(vceqq_u8(newVals, oldVals));
+        uint64_t same0 = vgetq_lane_u64(same, 0);
+        uint64_t same1 = vgetq_lane_u64(same, 1);
+        if ((same0 & same1) != UINT64_MAX) {
+            changed = true;
+            if (same0 != UINT64_MAX) {
+                setSlot(slotBits, firstSlot + i);
+            }
+            if (same1 != UINT64_MAX) {
+                setSlot(slotBits, firstSlot + i + 1);
+            }
+        }
+    }
+#endif
+
+    // Whatever is left (or everything if no SIMD)
+    if (diffEach(slotBits, newPtr, oldPtr, firstSlot, i, slots)) {
+        changed = true;
+    }
+
+    return changed;
+}
+
+/// <summary>
+/// Same as diffSlots but always one slot at a time, which is what
+/// diffSlots does without SIMD. Lets a build compare the two.
+/// </summary>
+bool diffSlotsScalar(unsigned int* slotBits, const char* simVarsPtr, const char* prevVarsPtr, int offset, int size)
+{
+    return diffEach(slotBits, simVarsPtr + offset, prevVarsPtr + offset, offset / 8, 0, size / 8);
+}
+
+/// <summary>
+/// Which instructions diffSlots was built to use
+/// </summary>
+const char* diffMethod()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#elif defined(__ARM_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
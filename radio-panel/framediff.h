@@ -0,0 +1,14 @@
+#ifndef _FRAMEDIFF_H_
+#define _FRAMEDIFF_H_
+
+#include "simvarDefs.h"
+
+// Every field starts on an 8 byte slot of SimVars
+const int SlotCount = sizeof(SimVars) / 8;
+const int SlotWords = (SlotCount + 31) / 32;
+
+bool diffSlots(unsigned int* slotBits, const char* simVarsPtr, const char* prevVarsPtr, int offset, int size);
+bool diffSlotsScalar(unsigned int* slotBits, const char* simVarsPtr, const char* prevVarsPtr, int offset, int size);
+const char* diffMethod();
+
+#endif // _FRAMEDIFF_H_
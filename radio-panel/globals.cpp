@@ -1,100 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include "globals.h"
+#include "settings.h"
 #include "simvars.h"
 
 extern globalVars globals;
 
-const int deltaDoubleSize = sizeof(DeltaDouble);
-const int deltaStringSize = sizeof(DeltaString);
+const char* StartsWithGroup = "Aircraft/Title Starts With";
+const char* ContainsGroup = "Aircraft/Title Contains";
+const int MaxTitleNodes = 2048;
 
-void identifyAircraft(char* aircraft)
+struct AircraftName {
+    const char* name;
+    Aircraft aircraft;
+};
+
+// Names that can be used for an aircraft in settings
+const AircraftName AircraftNames[] = {
+    { "Cessna 152", CESSNA_152 },
+    { "Cessna 172", CESSNA_172 },
+    { "Cessna CJ4", CESSNA_CJ4 },
+    { "Savage Cub", SAVAGE_CUB },
+    { "Shock Ultra", SHOCK_ULTRA },
+    { "Airbus A310", AIRBUS_A310 },
+    { "FBW", FBW },
+    { "Boeing 747", BOEING_747 },
+    { "Spitfire", SUPERMARINE_SPITFIRE },
+    { "PA28", JUSTFLIGHT_PA28 },
+    { NULL, UNDEFINED }
+};
+
+struct AircraftTitle {
+    const char* title;
+    Aircraft aircraft;
+};
+
+// Used if settings have no Aircraft section
+const AircraftTitle DefaultStartsWith[] = {
+    { "Cessna 152", CESSNA_152 },
+    { "Cessna Skyhawk", CESSNA_172 },
+    { "Cessna CJ4", CESSNA_CJ4 },
+    { "Asobo Savage Cub", SAVAGE_CUB },
+    { "Savage Shock Ultra", SHOCK_ULTRA },
+    { "Boeing 747-8", BOEING_747 },
+    { "Salty Boeing 747", BOEING_747 },
+    { "FlyingIron Spitfire", SUPERMARINE_SPITFIRE },
+    { "Just Flight PA28", JUSTFLIGHT_PA28 },
+    { NULL, UNDEFINED }
+};
+
+const AircraftTitle DefaultContains[] = {
+    { "A31", AIRBUS_A310 },
+    { "A32", FBW },
+    { "A38", FBW },
+    { NULL, UNDEFINED }
+};
+
+/// <summary>
+/// Aircraft titles are compiled into a trie at startup. Each node is
+/// one char of a title with its first child one char further on and
+/// its siblings the other chars that can follow its parent. A node
+/// records the aircraft for any title that ends there.
+/// </summary>
+struct TitleNode {
+    char ch;
+    short child;
+    short sibling;
+    Aircraft startsWith;
+    Aircraft contains;
+};
+
+TitleNode titleNodes[MaxTitleNodes];    // Node 0 is the root
+int titleNodeCount = 1;
+
+/// <summary>
+/// Returns the node for ch below parent or 0 if there isn't one
+/// </summary>
+int findChild(int parent, char ch)
 {
-    // Identify aircraft
-    if (strcmp(aircraft, globals.lastAircraft) != 0) {
-        bool foundAircraft = false;
-
-        char* pos = strchr(aircraft, '3');
-        if (pos && *(pos - 1) == 'A') {
-            if (*(pos + 1) == '1') {
-                globals.aircraft = AIRBUS_A310;
-                foundAircraft = true;
-            }
-            else if (*(pos + 1) == '2' || *(pos + 1) == '8') {
-                globals.aircraft = FBW;
-                foundAircraft = true;
-            }
+    for (int node = titleNodes[parent].child; node != 0; node = titleNodes[node].sibling) {
+        if (titleNodes[node].ch == ch) {
+            return node;
         }
+    }
 
-        if (!foundAircraft) {
-            if (strncmp(aircraft, globals.Cessna_152_Text, globals.Cessna_152_Len) == 0) {
-                globals.aircraft = CESSNA_152;
-            }
-            else if (strncmp(aircraft, globals.Cessna_172_Text, globals.Cessna_172_Len) == 0) {
-                globals.aircraft = CESSNA_172;
-            }
-            else if (strncmp(aircraft, globals.Cessna_CJ4_Text, globals.Cessna_CJ4_Len) == 0) {
-                globals.aircraft = CESSNA_CJ4;
-            }
-            else if (strncmp(aircraft, globals.Savage_Cub_Text, globals.Savage_Cub_Len) == 0) {
-                globals.aircraft = SAVAGE_CUB;
-            }
-            else if (strncmp(aircraft, globals.Shock_Ultra_Text, globals.Shock_Ultra_Len) == 0) {
-                globals.aircraft = SHOCK_ULTRA;
-            }
-            else if (strncmp(aircraft, globals.Boeing_747_Text, globals.Boeing_747_Len) == 0) {
-                globals.aircraft = BOEING_747;
-            }
-            else if (strncmp(aircraft, globals.Salty_Boeing_747_Text, globals.Salty_Boeing_747_Len) == 0) {
-                globals.aircraft = BOEING_747;
-            }
-            else if (strncmp(aircraft, globals.Supermarine_Spitfire_Text, globals.Supermarine_Spitfire_Len) == 0) {
-                globals.aircraft = SUPERMARINE_SPITFIRE;
-            }
-            else if (strncmp(aircraft, globals.JustFlight_PA28_Text, globals.JustFlight_PA28_Len) == 0) {
-                globals.aircraft = JUSTFLIGHT_PA28;
+    return 0;
+}
+
+void addTitle(const char* title, Aircraft aircraft, bool contains)
+{
+    int node = 0;
+
+    for (const char* ch = title; *ch != '\0'; ch++) {
+        int child = findChild(node, *ch);
+        if (child == 0) {
+            if (titleNodeCount == MaxTitleNodes) {
+                printf("Too many aircraft titles in settings\n");
+                exit(1);
             }
-            else {
-                // Need to flip between other aircraft so that instruments
-                // can detect the aircraft has changed.
-                if (globals.aircraft == OTHER_AIRCRAFT) {
-                    globals.aircraft = OTHER_AIRCRAFT2;
-                }
-                else {
-                    globals.aircraft = OTHER_AIRCRAFT;
-                }
+            child = titleNodeCount++;
+            titleNodes[child].ch = *ch;
+            titleNodes[child].sibling = titleNodes[node].child;
+            titleNodes[node].child = child;
+        }
+        node = child;
+    }
+
+    if (contains) {
+        titleNodes[node].contains = aircraft;
+    }
+    else {
+        titleNodes[node].startsWith = aircraft;
+    }
+}
+
+Aircraft aircraftNamed(const char* name, const char* title)
+{
+    for (int i = 0; AircraftNames[i].name; i++) {
+        if (_stricmp(AircraftNames[i].name, name) == 0) {
+            return AircraftNames[i].aircraft;
+        }
+    }
+
+    printf("Unknown aircraft \"%s\" for title \"%s\", use one of:", name, title);
+    for (int i = 0; AircraftNames[i].name; i++) {
+        printf(" \"%s\"", AircraftNames[i].name);
+    }
+    printf("\n");
+    exit(1);
+}
+
+bool addSettingTitles(const char* group, bool contains)
+{
+    char title[256];
+    char name[256];
+    int pos = 0;
+    bool found = false;
+
+    while (globals.allSettings->getNext(group, &pos, title, name)) {
+        addTitle(title, aircraftNamed(name, title), contains);
+        found = true;
+    }
+
+    return found;
+}
+
+/// <summary>
+/// Build the title trie from the Aircraft section of settings. Titles
+/// in "Title Starts With" must match from the start and the longest
+/// match wins. Titles in "Title Contains" can match anywhere and are
+/// checked first.
+/// </summary>
+void loadAircraft()
+{
+    bool startsWith = addSettingTitles(StartsWithGroup, false);
+    bool contains = addSettingTitles(ContainsGroup, true);
+
+    if (!startsWith && !contains) {
+        for (int i = 0; DefaultStartsWith[i].title; i++) {
+            addTitle(DefaultStartsWith[i].title, DefaultStartsWith[i].aircraft, false);
+        }
+        for (int i = 0; DefaultContains[i].title; i++) {
+            addTitle(DefaultContains[i].title, DefaultContains[i].aircraft, true);
+        }
+    }
+}
+
+Aircraft matchTitle(const char* title)
+{
+    for (const char* start = title; *start != '\0'; start++) {
+        int node = 0;
+        for (const char* ch = start; *ch != '\0' && (node = findChild(node, *ch)) != 0; ch++) {
+            if (titleNodes[node].contains != UNDEFINED) {
+                return titleNodes[node].contains;
             }
         }
-        strcpy(globals.lastAircraft, aircraft);
     }
+
+    Aircraft found = UNDEFINED;
+    int node = 0;
+    for (const char* ch = title; *ch != '\0' && (node = findChild(node, *ch)) != 0; ch++) {
+        if (titleNodes[node].startsWith != UNDEFINED) {
+            found = titleNodes[node].startsWith;
+        }
+    }
+
+    return found;
 }
 
 /// <summary>
-/// Server can send us a delta rather than full data so we need to unpack it.
+/// Only called when the aircraft title has changed (or on a full frame)
 /// </summary>
-void receiveDelta(char *deltaData, int deltaSize, char* simVarsPtr)
+void identifyAircraft(char* aircraft)
 {
-    char* dataPtr = deltaData;
-
-    int tempDeltaSize = deltaSize;
-    while (deltaSize > 0) {
-        DeltaDouble* deltaDouble = (DeltaDouble*)dataPtr;
-        if (deltaDouble->offset & 0x10000) {
-            // Must be a string
-            DeltaString* deltaString = (DeltaString*)dataPtr;
-            char* stringPtr = simVarsPtr + (deltaString->offset & 0xffff);
-            strncpy(stringPtr, deltaString->data, 32);
-            stringPtr[31] = '\0';
-
-            dataPtr += deltaStringSize;
-            deltaSize -= deltaStringSize;
+    if (strcmp(aircraft, globals.lastAircraft) == 0) {
+        return;
+    }
+
+    Aircraft found = matchTitle(aircraft);
+    if (found != UNDEFINED) {
+        globals.aircraft = found;
+    }
+    else {
+        // Need to flip between other aircraft so that instruments
+        // can detect the aircraft has changed.
+        if (globals.aircraft == OTHER_AIRCRAFT) {
+            globals.aircraft = OTHER_AIRCRAFT2;
         }
         else {
-            // Must be a double
-            char* doublePos = simVarsPtr + deltaDouble->offset;
-            double* doublePtr = (double*)doublePos;
-            *doublePtr = deltaDouble->data;
-
-            dataPtr += deltaDoubleSize;
-            deltaSize -= deltaDoubleSize;
+            globals.aircraft = OTHER_AIRCRAFT;
         }
     }
+
+    strcpy(globals.lastAircraft, aircraft);
 }
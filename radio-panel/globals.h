@@ -27,25 +27,6 @@ enum Aircraft {
 
 struct globalVars
 {
-    const char* Cessna_152_Text = "Cessna 152";
-    const int Cessna_152_Len = 10;
-    const char* Cessna_172_Text = "Cessna Skyhawk";
-    const int Cessna_172_Len = 14;
-    const char* Cessna_CJ4_Text = "Cessna CJ4";
-    const int Cessna_CJ4_Len = 10;
-    const char* Savage_Cub_Text = "Asobo Savage Cub";
-    const int Savage_Cub_Len = 16;
-    const char* Shock_Ultra_Text = "Savage Shock Ultra";
-    const int Shock_Ultra_Len = 18;
-    const char* Boeing_747_Text = "Boeing 747-8";
-    const int Boeing_747_Len = 12;
-    const char* Salty_Boeing_747_Text = "Salty Boeing 747";
-    const int Salty_Boeing_747_Len = 16;
-    const char* Supermarine_Spitfire_Text = "FlyingIron Spitfire";
-    const int Supermarine_Spitfire_Len = 19;
-    const char* JustFlight_PA28_Text = "Just Flight PA28";
-    const int JustFlight_PA28_Len = 16;
-
     const int FastAircraftSpeed = 195;
 
     const char* BitmapDir = "bitmaps/";
@@ -4,6 +4,7 @@
 #include <set>
 #include <wiringPi.h>
 #include "settings.h"
+#include "simvars.h"
 #include "gpioctrl.h"
 
 const char* GpioGroup = "GPIO";
@@ -21,6 +22,8 @@ void watcher(gpioctrl*);
 
 gpioctrl::gpioctrl(bool initWiringPi)
 {
+    inputCount = 0;
+
     // Caller may want to initialise wiringPi themselves
     if (initWiringPi) {
         // Use BCM GPIO pin numbers
@@ -372,8 +375,10 @@ void gpioctrl::writeLed(int control, bool on)
 void watcher(gpioctrl *t)
 {
     int state;
+    bool changed;
 
     while (!globals.quit) {
+        changed = false;
         for (int control = 0; control < t->controlCount; control++) {
             // Check control rotation
             if (t->gpio[control][Rot1] != INT_MIN) {
@@ -408,6 +413,7 @@ void watcher(gpioctrl *t)
                     }
 
                     t->lastRotateState[control] = state;
+                    changed = true;
                 }
             }
 
@@ -426,12 +432,26 @@ void watcher(gpioctrl *t)
                     }
 
                     t->lastPushState[control] = state;
+                    changed = true;
                 }
             }
 
             // Check control toggle
             if (t->gpio[control][Toggle] != INT_MIN) {
-                t->toggleValue[control] = digitalRead(t->gpio[control][Toggle]);
+                state = digitalRead(t->gpio[control][Toggle]);
+                if (state != t->toggleValue[control]) {
+                    t->toggleValue[control] = state;
+                    changed = true;
+                }
+            }
+        }
+
+        if (changed) {
+            t->inputCount++;
+
+            // Let data link know the panel is being used
+            if (globals.simVars) {
+                globals.simVars->activity();
             }
         }
 
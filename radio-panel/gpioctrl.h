@@ -3,6 +3,7 @@
 
 #include <climits>
 #include <thread>
+#include <atomic>
 #include "globals.h"
 
 extern globalVars globals;
@@ -35,6 +36,9 @@ public:
     int lastPushState[MaxControls];
     bool clockwise[MaxControls];
 
+    // Bumped by the watcher whenever any input changes
+    std::atomic<unsigned int> inputCount;
+
 public:
     gpioctrl(bool initWiringPi);
     ~gpioctrl();
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+#include "linkstats.h"
+
+// Responses slower than this are counted as timeouts
+const long long LateResponseNs = 500000000LL;
+
+linkstats::linkstats()
+{
+    memset(rttHistogram, 0, sizeof(rttHistogram));
+    memset(sentSeq, 0, sizeof(sentSeq));
+    memset(sentNs, 0, sizeof(sentNs));
+    memset(answered, 0, sizeof(answered));
+
+    writeBatches = 0;
+    writeEvents = 0;
+    writeBytes = 0;
+    reliableEvents = 0;
+}
+
+/// <summary>
+/// Record a data request. If the request that previously used this
+/// history slot never got a response it must have been lost.
+/// </summary>
+void linkstats::requestSent(int seq, long long nowNs)
+{
+    int slot = seq & (SentHistory - 1);
+
+    if (sentSeq[slot] != 0 && !answered[slot]) {
+        lost++;
+    }
+
+    sentSeq[slot] = seq;
+    sentNs[slot] = nowNs;
+    answered[slot] = false;
+    requests++;
+}
+
+/// <summary>
+/// Record the response to a data request and update the round trip
+/// time statistics. Uses the same smoothing as TCP (RFC 6298).
+/// </summary>
+void linkstats::responseReceived(int seq, long long nowNs)
+{
+    int slot = seq & (SentHistory - 1);
+
+    if (sentSeq[slot] != seq || answered[slot]) {
+        // Duplicate or too old to measure
+        return;
+    }
+
+    answered[slot] = true;
+    responses++;
+
+    long long rttNs = nowNs - sentNs[slot];
+    if (rttNs > LateResponseNs) {
+        late++;
+    }
+
+    if (rttCount == 0) {
+        rttMinNs = rttNs;
+        rttMaxNs = rttNs;
+        rttAvgNs = rttNs;
+        rttVarNs = rttNs / 2.0;
+    }
+    else {
+        if (rttNs < rttMinNs) rttMinNs = rttNs;
+        if (rttNs > rttMaxNs) rttMaxNs = rttNs;
+        double diff = rttNs - rttAvgNs;
+        rttVarNs += ((diff < 0 ? -diff : diff) - rttVarNs) / 4;
+        rttAvgNs += diff / 8;
+    }
+    rttCount++;
+
+    // Bucket is log2 of RTT in microseconds
+    long long rttUs = rttNs / 1000;
+    int bucket = 0;
+    while (rttUs > 1 && bucket < RttBuckets - 1) {
+        rttUs >>= 1;
+        bucket++;
+    }
+    rttHistogram[bucket]++;
+}
+
+void linkstats::frameReceived(bool full, int bytes)
+{
+    if (full) {
+        fullFrames++;
+        fullBytes += bytes;
+    }
+    else {
+        deltaFrames++;
+        deltaBytes += bytes;
+    }
+}
+
+void linkstats::writeSent(int events, int bytes)
+{
+    writeBatches++;
+    writeEvents += events;
+    writeBytes += bytes;
+}
+
+/// <summary>
+/// Record the link being declared lost after no response for silenceNs
+/// </summary>
+void linkstats::linkLost(long long silenceNs)
+{
+    outages++;
+    detectNs += silenceNs;
+}
+
+/// <summary>
+/// Record the link responding again downNs after it was declared lost
+/// </summary>
+void linkstats::linkRecovered(long long downNs)
+{
+    recoveries++;
+    recoverNs += downNs;
+}
+
+/// <summary>
+/// Estimate an RTT percentile (0 to 100) from the histogram,
+/// interpolating within the bucket it falls in.
+/// </summary>
+double linkstats::rttPercentileMs(double percentile)
+{
+    if (rttCount == 0) {
+        return 0;
+    }
+
+    double target = rttCount * percentile / 100.0;
+    double total = 0;
+
+    for (int bucket = 0; bucket < RttBuckets; bucket++) {
+        if (rttHistogram[bucket] > 0 && total + rttHistogram[bucket] >= target) {
+            double lowUs = (bucket == 0) ? 0 : (double)(1LL << bucket);
+            double highUs = (double)(2LL << bucket);
+            double fraction = (target - total) / rttHistogram[bucket];
+            return (lowUs + (highUs - lowUs) * fraction) / 1000.0;
+        }
+        total += rttHistogram[bucket];
+    }
+
+    return rttMaxNs / 1000000.0;
+}
+
+void linkstats::dump()
+{
+    printf("DataLink stats:\n");
+    printf("  Requests %lld, responses %lld, lost %lld, timeouts %lld, stale frames %lld\n",
+        requests, responses, lost, late, stale);
+
+    if (rttCount > 0) {
+        printf("  RTT avg %.2fms (var %.2fms), min %.2fms, max %.2fms, p50 %.2fms, p90 %.2fms, p99 %.2fms\n",
+            rttAvgNs / 1000000.0, rttVarNs / 1000000.0, rttMinNs / 1000000.0, rttMaxNs / 1000000.0,
+            rttPercentileMs(50), rttPercentileMs(90), rttPercentileMs(99));
+
+        printf("  RTT histogram:");
+        for (int bucket = 0; bucket < RttBuckets; bucket++) {
+            if (rttHistogram[bucket] > 0) {
+                printf(" <%lldus:%lld", 2LL << bucket, rttHistogram[bucket]);
+            }
+        }
+        printf("\n");
+    }
+
+    printf("  Link suspect %lld times, lost %lld times", suspects, outages);
+    if (outages > 0) {
+        printf(" (%.0fms avg to detect)", detectNs / 1000000.0 / outages);
+    }
+    if (recoveries > 0) {
+        printf(", recovered %lld times (%.0fms avg to recover)", recoveries, recoverNs / 1000000.0 / recoveries);
+    }
+    printf("\n");
+
+    if (hubFrames > 0 || relayedWrites > 0) {
+        printf("  Hub frames %lld (%lld bytes), events relayed %lld\n", hubFrames, hubBytes, relayedWrites);
+    }
+    if (sharedFrames > 0) {
+        printf("  Shared memory frames %lld\n", sharedFrames);
+    }
+
+    printf("  Full frames %lld (%lld bytes), deltas %lld (%lld bytes)\n",
+        fullFrames, fullBytes, deltaFrames, deltaBytes);
+    printf("  Write batches %lld, events %lld (%lld bytes)\n",
+        writeBatches.load(), writeEvents.load(), writeBytes.load());
+    if (reliableEvents > 0) {
+        printf("  Reliable events %lld, resent %lld, given up %lld\n", reliableEvents.load(), resentEvents, abandonedEvents);
+    }
+    fflush(stdout);
+}
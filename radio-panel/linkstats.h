@@ -0,0 +1,66 @@
+#ifndef _LINKSTATS_H_
+#define _LINKSTATS_H_
+
+#include <atomic>
+
+// Must be a power of 2
+const int SentHistory = 64;
+
+// RTT histogram buckets are powers of 2 microseconds
+const int RttBuckets = 24;
+
+class linkstats
+{
+public:
+    // Updated by the data link thread
+    long long requests = 0;
+    long long responses = 0;
+    long long lost = 0;
+    long long late = 0;
+    long long stale = 0;
+    long long fullFrames = 0;
+    long long fullBytes = 0;
+    long long deltaFrames = 0;
+    long long deltaBytes = 0;
+    long long rttCount = 0;
+    long long rttMinNs = 0;
+    long long rttMaxNs = 0;
+    double rttAvgNs = 0;
+    double rttVarNs = 0;
+    long long rttHistogram[RttBuckets];
+    long long suspects = 0;
+    long long outages = 0;
+    long long detectNs = 0;
+    long long recoveries = 0;
+    long long recoverNs = 0;
+    long long hubFrames = 0;
+    long long hubBytes = 0;
+    long long relayedWrites = 0;
+    long long sharedFrames = 0;
+    long long resentEvents = 0;
+    long long abandonedEvents = 0;
+
+    // Send time of recent requests (indexed by seq & (SentHistory - 1))
+    int sentSeq[SentHistory];
+    long long sentNs[SentHistory];
+    bool answered[SentHistory];
+
+    // Updated by the main loop
+    std::atomic<long long> writeBatches;
+    std::atomic<long long> writeEvents;
+    std::atomic<long long> writeBytes;
+    std::atomic<long long> reliableEvents;
+
+public:
+    linkstats();
+    void requestSent(int seq, long long nowNs);
+    void responseReceived(int seq, long long nowNs);
+    void frameReceived(bool full, int bytes);
+    void writeSent(int events, int bytes);
+    void linkLost(long long silenceNs);
+    void linkRecovered(long long downNs);
+    double rttPercentileMs(double percentile);
+    void dump();
+};
+
+#endif // _LINKSTATS_H_
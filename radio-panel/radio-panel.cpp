@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <wiringPi.h>
 #include "gpioctrl.h"
@@ -18,6 +19,17 @@ const bool Debug = false;
 
 struct globalVars globals;
 
+// SimVars used by Radio panel. Only these are requested from the data link.
+const SimVarRange RadioPanelVars[] = {
+    { offsetof(SimVars, connected), offsetof(SimVars, connected) },
+    { offsetof(SimVars, elecBat1), offsetof(SimVars, elecBat2) },
+    { offsetof(SimVars, jbTcasMode), offsetof(SimVars, jbTcasMode) },
+    { offsetof(SimVars, sbEncoder), offsetof(SimVars, sbMode) },
+    { offsetof(SimVars, aircraft), offsetof(SimVars, batteryLoad) },
+    { offsetof(SimVars, com1Status), offsetof(SimVars, transponderCode) },
+    { -1, -1 }
+};
+
 radio* rad;
 
 /// <summary>
@@ -30,7 +42,7 @@ void init(const char *settingsFile = NULL)
     wiringPiSetupGpio();
 
     globals.allSettings = new settings(settingsFile);
-    globals.simVars = new simvars();
+    globals.simVars = new simvars(RadioPanelVars);
     globals.gpioCtrl = new gpioctrl(false);
 }
 
@@ -39,7 +51,7 @@ void init(const char *settingsFile = NULL)
 /// </summary>
 void updateCommon()
 {
-    SimVars* simVars = &globals.simVars->simVars;
+    SimVars* simVars = globals.simVars->simVars;
 
     // Electrics check
     if (globals.aircraft == FBW) {
@@ -64,9 +76,15 @@ void updateCommon()
 /// </summary>
 void doUpdate()
 {
+    // Pick up latest values from data link
+    globals.simVars->snapshot();
+
     updateCommon();
 
     rad->update();
+
+    // Send any events generated by this update
+    globals.simVars->flush();
 }
 
 ///
@@ -94,5 +112,8 @@ int main(int argc, char **argv)
         usleep(100000);
     }
 
+    // Shut down data link cleanly
+    delete globals.simVars;
+
     return 0;
 }
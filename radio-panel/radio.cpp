@@ -1,11 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include "gpioctrl.h"
 #include "radio.h"
 
 radio::radio()
 {
-    simVars = &globals.simVars->simVars;
+    simVars = globals.simVars->simVars;
     addGpio();
 
     // Initialise 7-segment displays
@@ -22,6 +23,11 @@ void radio::blankDisplays()
 
 void radio::render()
 {
+    if (!refresh) {
+        // Displays already show the current state
+        return;
+    }
+
     if (!globals.electrics || (loadedAircraft == CESSNA_152 && simVars->com1Volume == 0 && simVars->com2Volume == 0)) {
         // Turn off 7-segment displays
         blankDisplays();
@@ -195,6 +201,9 @@ void radio::writeAdf(unsigned char* display, double freq)
 
 void radio::update()
 {
+    // Use latest snapshot for this frame
+    simVars = globals.simVars->simVars;
+
     // Check for aircraft change
     bool aircraftChanged = (globals.electrics && loadedAircraft != globals.aircraft);
     if (aircraftChanged) {
@@ -233,6 +242,28 @@ void radio::update()
         receiveAllHideDelay = 60;
     }
 
+    // Nothing to recalculate unless a SimVar or GPIO input the radio
+    // uses has changed. Keep going while anything is timing out (and
+    // for one more frame so the display catches up when it ends).
+    unsigned int inputCount = globals.gpioCtrl->inputCount;
+    refresh = aircraftChanged || timing || globals.electrics != lastElectrics || inputCount != lastInputCount ||
+        globals.simVars->changed(offsetof(SimVars, jbTcasMode), offsetof(SimVars, jbTcasMode)) ||
+        globals.simVars->changed(offsetof(SimVars, sbEncoder), offsetof(SimVars, sbMode)) ||
+        globals.simVars->changed(offsetof(SimVars, com1Status), offsetof(SimVars, transponderCode));
+    lastElectrics = globals.electrics;
+    lastInputCount = inputCount;
+
+    // B747 Bug - Force squawk code back to set value. Must keep trying
+    // until the sim agrees, not just when something changes.
+    if (loadedAircraft == BOEING_747 && lastSquawkAdjust == 0 && squawk != 0 && simVars->transponderCode != squawk) {
+        int newVal = adjustSquawk(0);
+        globals.simVars->write(KEY_XPNDR_SET, newVal);
+    }
+
+    if (!refresh) {
+        return;
+    }
+
     time(&now);
     gpioFreqWholeInput();
     gpioFreqFracInput();
@@ -299,21 +330,16 @@ void radio::update()
         // Current value is unknown so always read
         squawk = simVars->transponderCode;
     }
-    else if (lastSquawkAdjust == 0) {
-        if (loadedAircraft == BOEING_747 && squawk != 0) {
-            // B747 Bug - Force squawk code back to set value
-            if (simVars->transponderCode != squawk) {
-                int newVal = adjustSquawk(0);
-                globals.simVars->write(KEY_XPNDR_SET, newVal);
-            }
-        }
-        else {
-            squawk = simVars->transponderCode;
-        }
+    else if (lastSquawkAdjust == 0 && (loadedAircraft != BOEING_747 || squawk == 0)) {
+        // B747 keeps its set value (see above)
+        squawk = simVars->transponderCode;
     }
 
     // Seat Belts
     showSeatBelts = simVars->seatBeltsSwitch;
+
+    timing = lastFreqAdjust != 0 || lastFreqPush != 0 || lastSquawkAdjust != 0 || lastSquawkPush != 0 ||
+        lastTcasAdjust != 0 || receiveAllHideDelay > 0;
 }
 
 void radio::addGpio()
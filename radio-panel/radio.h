@@ -82,6 +82,12 @@ private:
     time_t lastTcasAdjust = 0;
     time_t now;
 
+    // Only recalculate and render when something has changed
+    bool refresh = true;
+    bool timing = true;
+    bool lastElectrics = false;
+    unsigned int lastInputCount = 0;
+
 public:
     radio();
     void render();
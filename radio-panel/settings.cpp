@@ -166,7 +166,7 @@ void settings::getString(const char* group, const char* name, char* str)
         }
     }
 
-    str = NULL;
+    // Not found so str keeps its default
 }
 
 int settings::getInt(const char* group, const char* name)
@@ -179,3 +179,17 @@ int settings::getInt(const char* group, const char* name)
 
     return INT_MIN;
 }
+
+bool settings::getNext(const char* group, int* pos, char* name, char* value)
+{
+    for (; *pos < settingCount; (*pos)++) {
+        if (strcmp(allSettings[*pos].group, group) == 0) {
+            strcpy(name, allSettings[*pos].name);
+            strcpy(value, allSettings[*pos].value);
+            (*pos)++;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -22,6 +22,7 @@ public:
     settings(const char* settingsFile);
     void getString(const char* group, const char* name, char* str);
     int getInt(const char* group, const char* name);
+    bool getNext(const char* group, int* pos, char* name, char* value);
 
 private:
     void readString(char* buf, int* pos, char* name);
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "sharedvars.h"
+
+const int MaxReadTries = 4;
+
+sharedvars::~sharedvars()
+{
+    if (!segment) {
+        return;
+    }
+
+    if (owner) {
+        // Leave the last SimVars behind for whoever starts next
+        unsigned int seq = segment->seq.load(std::memory_order_relaxed);
+        segment->seq.store(seq + 1, std::memory_order_relaxed);
+        segment->linked = 0;
+        segment->ownerPid = 0;
+        segment->seq.store(seq + 2, std::memory_order_release);
+        syscall(SYS_futex, (int*)&segment->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+
+    munmap(segment, sizeof(SharedSegment));
+}
+
+/// <summary>
+/// Create the segment (or take over an existing one if its owner has
+/// gone) so this process can publish SimVars to others. The previous
+/// owner's SimVars stay readable until the first write.
+/// </summary>
+void sharedvars::create(const char* name)
+{
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd == -1) {
+        printf("Failed to create shared memory %s\n", name);
+        exit(1);
+    }
+
+    if (ftruncate(fd, sizeof(SharedSegment)) != 0) {
+        printf("Failed to size shared memory %s\n", name);
+        exit(1);
+    }
+
+    segment = (SharedSegment*)mmap(NULL, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        segment = NULL;
+        printf("Failed to map shared memory %s\n", name);
+        exit(1);
+    }
+
+    if (memcmp(segment->magic, SharedMagic, sizeof(SharedMagic)) == 0 && segment->simVarsSize == sizeof(SimVars)) {
+        if (segment->ownerPid != getpid() && ownerAlive()) {
+            printf("Shared memory %s is already published by process %d\n", name, segment->ownerPid.load());
+            exit(1);
+        }
+    }
+    else {
+        // New segment (all zero) or one built with different SimVars
+        memset((void*)segment, 0, sizeof(SharedSegment));
+        memcpy(segment->magic, SharedMagic, sizeof(SharedMagic));
+        segment->simVarsSize = sizeof(SimVars);
+    }
+
+    // Previous owner may have died mid write
+    unsigned int seq = segment->seq;
+    if (seq & 1) {
+        segment->seq = seq + 1;
+    }
+
+    segment->ownerPid = getpid();
+    owner = true;
+}
+
+/// <summary>
+/// Map an existing segment read-only. Returns false if nobody has
+/// created it yet.
+/// </summary>
+bool sharedvars::attach(const char* name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SharedSegment)) {
+        // Owner is still setting it up
+        close(fd);
+        return false;
+    }
+
+    segment = (SharedSegment*)mmap(NULL, sizeof(SharedSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        segment = NULL;
+        printf("Failed to map shared memory %s\n", name);
+        exit(1);
+    }
+
+    if (memcmp(segment->magic, SharedMagic, sizeof(SharedMagic)) != 0) {
+        munmap(segment, sizeof(SharedSegment));
+        segment = NULL;
+        return false;
+    }
+
+    if (segment->simVarsSize != sizeof(SimVars)) {
+        printf("Shared memory %s was published with different SimVars\n", name);
+        exit(1);
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Publish SimVars and wake any readers
+/// </summary>
+void sharedvars::write(const SimVars* simVars, bool linked, const sockaddr_in* linkAddr)
+{
+    unsigned int seq = segment->seq.load(std::memory_order_relaxed);
+
+    segment->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    segment->linked = linked ? 1 : 0;
+    segment->linkAddr = *linkAddr;
+    memcpy(&segment->simVars, simVars, sizeof(SimVars));
+
+    segment->seq.store(seq + 2, std::memory_order_release);
+    syscall(SYS_futex, (int*)&segment->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/// <summary>
+/// Sleep until seq moves on from seenSeq or the timeout expires.
+/// Returns the current seq.
+/// </summary>
+unsigned int sharedvars::wait(unsigned int seenSeq, long long timeoutNs)
+{
+    unsigned int seq = segment->seq.load(std::memory_order_acquire);
+    if (seq == seenSeq) {
+        timespec timeout;
+        timeout.tv_sec = timeoutNs / 1000000000LL;
+        timeout.tv_nsec = timeoutNs % 1000000000LL;
+
+        // Returns straight away if seq has already changed
+        syscall(SYS_futex, (int*)&segment->seq, FUTEX_WAIT, seenSeq, &timeout, NULL, 0);
+        seq = segment->seq.load(std::memory_order_acquire);
+    }
+
+    return seq;
+}
+
+/// <summary>
+/// Take a consistent copy of the published SimVars. Returns false if
+/// the owner kept writing while we were reading.
+/// </summary>
+bool sharedvars::read(SimVars* simVars, bool* linked, sockaddr_in* linkAddr, unsigned int* seq)
+{
+    for (int tries = 0; tries < MaxReadTries; tries++) {
+        unsigned int before = segment->seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        *linked = (segment->linked != 0);
+        *linkAddr = segment->linkAddr;
+        memcpy(simVars, &segment->simVars, sizeof(SimVars));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment->seq.load(std::memory_order_relaxed) == before) {
+            *seq = before;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Returns true if the process that owns the segment is still running
+/// </summary>
+bool sharedvars::ownerAlive()
+{
+    int pid = segment->ownerPid;
+    return pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
@@ -0,0 +1,45 @@
+#ifndef _SHAREDVARS_H_
+#define _SHAREDVARS_H_
+
+#include <atomic>
+#include <netinet/in.h>
+#include "simvarDefs.h"
+
+/// <summary>
+/// A shared memory segment lets one panel process own the data link
+/// and publish SimVars to other panel processes on the same machine.
+///
+/// seq is a seqlock. It is odd while the owner is writing so a reader
+/// copies everything and only keeps the copy if seq was even and
+/// unchanged throughout. Readers sleep on seq as a futex and the owner
+/// wakes them after every write.
+/// </summary>
+const char SharedMagic[8] = "RPSHM01";
+
+struct SharedSegment {
+    char magic[8];
+    int simVarsSize;
+    std::atomic<unsigned int> seq;
+    std::atomic<int> ownerPid;
+    int linked;             // Owner has a data link
+    sockaddr_in linkAddr;   // Where the owner's data link is (for events)
+    SimVars simVars;
+};
+
+class sharedvars
+{
+private:
+    SharedSegment* segment = NULL;
+    bool owner = false;
+
+public:
+    ~sharedvars();
+    void create(const char* name);
+    bool attach(const char* name);
+    void write(const SimVars* simVars, bool linked, const sockaddr_in* linkAddr);
+    unsigned int wait(unsigned int seenSeq, long long timeoutNs);
+    bool read(SimVars* simVars, bool* linked, sockaddr_in* linkAddr, unsigned int* seq);
+    bool ownerAlive();
+};
+
+#endif // _SHAREDVARS_H_
@@ -1,191 +1,35 @@
 #include <stdio.h>
+#include <stddef.h>
 #include "simvarDefs.h"
 
 const char* versionString = "v2.0.5";
 
 const char* SimVarDefs[][2] = {
-    // Vars for Jetbridge (must come first)
-    { "Apu Master Sw", "jetbridge" },
-    { "Apu Bleed", "jetbridge" },
-    { "Elec Bat1", "jetbridge" },
-    { "Elec Bat2", "jetbridge" },
-    { "Autopilot Managed Speed", "jetbridge" },
-    { "Autopilot Managed Heading", "jetbridge" },
-    { "Autopilot Managed Altitude", "jetbridge" },
-    { "Lateral Mode", "jetbridge" },
-    { "Vertical Mode", "jetbridge" },
-    { "Loc Mode", "jetbridge" },
-    { "Appr Mode", "jetbridge" },
-    { "Autothrust Mode", "jetbridge" },
-    { "Show Mach", "jetbridge" },
-    { "Autobrake Armed", "jetbridge" },
-    { "Pitch Trim", "jetbridge" },
-    { "Tcas Mode", "jetbridge" },
-    { "SwitchBox Encoder 1", "jetbridge" },
-    { "SwitchBox Encoder 2", "jetbridge" },
-    { "SwitchBox Encoder 3", "jetbridge" },
-    { "SwitchBox Encoder 4", "jetbridge" },
-    { "SwitchBox Button 1", "jetbridge" },
-    { "SwitchBox Button 2", "jetbridge" },
-    { "SwitchBox Button 3", "jetbridge" },
-    { "SwitchBox Button 4", "jetbridge" },
-    { "SwitchBox Button 5", "jetbridge" },
-    { "SwitchBox Button 6", "jetbridge" },
-    { "SwitchBox Button 7", "jetbridge" },
-    { "SwitchBox Mode", "jetbridge" },
-    { "SwitchBox Park Brake", "jetbridge" },
-
-    // Vars required for all panels (screensaver, aircraft identification etc.)
-    { "Title", "string32" },
-    { "Estimated Cruise Speed", "knots" },
-    { "Electrical Main Bus Voltage", "volts" },
-    { "Electrical Battery Load", "amperes" },
-
-    // Vars for Power/Lights panel
-    { "Light On States", "mask" },
-    { "Flaps Num Handle Positions", "number" },
-    { "Flaps Handle Index", "number" },
-    { "Brake Parking Position", "bool" },
-    { "Pushback State", "enum" },
-    { "Apu Switch", "bool" },
-    { "Apu Pct Rpm", "percent" },
-
-    // Vars for Radio panel
-    { "Com Status:1", "enum" },
-    { "Com Transmit:1", "bool" },
-    { "Com Active Frequency:1", "mhz" },
-    { "Com Standby Frequency:1", "mhz" },
-    { "Nav Active Frequency:1", "mhz" },
-    { "Nav Standby Frequency:1", "mhz" },
-    { "Com Status:2", "enum" },
-    { "Com Transmit:2", "bool" },
-    { "Com Active Frequency:2", "mhz" },
-    { "Com Standby Frequency:2", "mhz" },
-    { "Nav Active Frequency:2", "mhz" },
-    { "Nav Standby Frequency:2", "mhz" },
-    { "Com Receive:1", "bool" },
-    { "Com Receive:2", "bool" },
-    { "Adf Active Frequency:1", "khz" },
-    { "Adf Standby Frequency:1", "khz" },
-    { "Com Volume:1", "percent" },
-    { "Com Volume:2", "percent" },
-    { "Cabin Seatbelts Alert Switch", "bool" },
-    { "Transponder State:1", "enum" },
-    { "Transponder Code:1", "bco16" },
-
-    // Vars for Autopilot panel
-    { "Indicated Altitude", "feet" },
-    { "Airspeed Indicated", "knots" },
-    { "Airspeed Mach", "mach" },
-    { "Plane Heading Degrees Magnetic", "degrees" },
-    { "Vertical Speed", "feet per second" },
-    { "Autopilot Available", "bool" },
-    { "Autopilot Master", "bool" },
-    { "Autopilot Flight Director Active", "bool" },
-    { "Autopilot Heading Lock Dir", "degrees" },
-    { "Autopilot Heading Lock", "bool" },
-    { "Autopilot Heading Slot Index", "number" },
-    { "Autopilot Wing Leveler", "bool" },
-    { "Autopilot Altitude Lock Var", "feet" },
-    { "Autopilot Altitude Lock Var:3", "feet" },
-    { "Autopilot Altitude Lock", "bool" },
-    { "Autopilot Nav1 Lock", "bool" },
-    { "Gps Drives Nav1", "bool" },
-    { "Autopilot Pitch Hold", "bool" },
-    { "Autopilot Vertical Hold Var", "feet/minute" },
-    { "Autopilot Vertical Hold", "bool" },
-    { "Autopilot VS Slot Index", "number" },
-    { "Autopilot Airspeed Hold Var", "knots" },
-    { "Autopilot Mach Hold Var", "number" },
-    { "Autopilot Airspeed Hold", "bool" },
-    { "Autopilot Approach Hold", "bool" },
-    { "Autopilot Glideslope Hold", "bool" },
-    { "General Eng Throttle Lever Position:1", "percent" },
-    { "Autothrottle Active", "bool" },
-
-    // Remaining vars for Instrument panel
-    { "Kohlsman Setting Hg", "inHg" },
-    { "Attitude Indicator Pitch Degrees", "degrees" },
-    { "Attitude Indicator Bank Degrees", "degrees" },
-    { "Airspeed True", "knots" },
-    { "Airspeed True Calibrate", "degrees" },
-    { "Plane Heading Degrees True", "degrees" },
-    { "Plane Alt Above Ground", "feet" },
-    { "Turn Indicator Rate", "degrees per second" },
-    { "Turn Coordinator Ball", "position" },
-    { "Elevator Trim Position", "degrees" },
-    { "Rudder Trim Pct", "percent" },
-    { "Spoilers Handle Position", "percent" },
-    { "Auto Brake Switch Cb", "number" },
-    { "Zulu Time", "seconds" },
-    { "Local Time", "seconds" },
-    { "Absolute Time", "seconds" },
-    { "Ambient Temperature", "celsius" },
-    { "Number Of Engines", "number" },
-    { "General Eng Rpm:1", "rpm" },
-    { "Eng Rpm Animation Percent:1", "percent" },
-    { "General Eng Elapsed Time:1", "hours" },
-    { "Fuel Total Capacity", "gallons" },
-    { "Fuel Total Quantity", "gallons" },
-    { "Fuel Tank Left Main Level", "percent" },
-    { "Fuel Tank Right Main Level", "percent" },
-    { "Nav Obs:1", "degrees" },
-    { "Nav Radial Error:1", "degrees" },
-    { "Nav Glide Slope Error:1", "degrees" },
-    { "Nav ToFrom:1", "enum" },
-    { "Nav Gs Flag:1", "bool" },
-    { "Nav Obs:2", "degrees" },
-    { "Nav Radial Error:2", "degrees" },
-    { "Nav ToFrom:2", "enum" },
-    { "Nav Has Localizer:1", "bool" },
-    { "Nav Localizer:1", "degrees" },
-    { "Gps Wp Cross Trk", "meters" },
-    { "Adf Radial:1", "degrees" },
-    { "Adf Card", "degrees" },
-    { "Is Gear Retractable", "bool" },
-    { "Gear Left Position", "percent" },
-    { "Gear Center Position", "percent" },
-    { "Gear Right Position", "percent" },
-    { "Rudder Position", "position" },
-    { "Brake Left Position", "percent" },
-    { "Brake Right Position", "percent" },
-    { "General Eng Oil Temperature:1", "fahrenheit" },
-    { "General Eng Oil Temperature:2", "fahrenheit" },
-    { "General Eng Oil Temperature:3", "fahrenheit" },
-    { "General Eng Oil Temperature:4", "fahrenheit" },
-    { "General Eng Oil Pressure:1", "psi" },
-    { "General Eng Oil Pressure:2", "psi" },
-    { "General Eng Oil Pressure:3", "psi" },
-    { "General Eng Oil Pressure:4", "psi" },
-    { "General Eng Exhaust Gas Temperature:1", "celsius" },
-    { "General Eng Exhaust Gas Temperature:2", "celsius" },
-    { "General Eng Exhaust Gas Temperature:3", "celsius" },
-    { "General Eng Exhaust Gas Temperature:4", "celsius" },
-    { "Engine Type", "enum" },
-    { "Max Rated Engine RPM", "rpm" },
-    { "Turb Eng N1:1", "percent" },
-    { "Turb Eng N1:2", "percent" },
-    { "Turb Eng N1:3", "percent" },
-    { "Turb Eng N1:4", "percent" },
-    { "Prop RPM:1", "rpm" },
-    { "Eng Manifold Pressure:1", "inches of mercury" },
-    { "Eng Fuel Flow GPH:1", "gallons per hour" },
-    { "Eng Fuel Flow GPH:2", "gallons per hour" },
-    { "Eng Fuel Flow GPH:3", "gallons per hour" },
-    { "Eng Fuel Flow GPH:4", "gallons per hour" },
-    { "Suction Pressure", "inches of mercury" },
-    { "Sim On Ground", "bool" },
-    { "G Force", "gforce"},
-    { "Atc Id", "string32" },
-    { "Atc Airline", "string32" },
-    { "Atc Flight Number", "string32" },
-    { "Atc Heavy", "bool" },
-    // Internal variables must come last
-    { "Landing Rate", "internal" },
-    { "Skytrack State", "internal" },
+#define SIMVAR(member, name, units, init) { name, units },
+#define SIMVAR_STRING(member, name) { name, "string32" },
+#define SIMVAR_ARRAY(member, count)
+#define SIMVAR_ELEMENT(member, index, name, units) { name, units },
+#include "simvarSchema.h"
+#undef SIMVAR
+#undef SIMVAR_STRING
+#undef SIMVAR_ARRAY
+#undef SIMVAR_ELEMENT
     { NULL, NULL }
 };
 
+const SchemaField SimVarSchema[] = {
+#define SIMVAR(member, name, units, init) { name, units, offsetof(SimVars, member), sizeof(double) },
+#define SIMVAR_STRING(member, name) { name, "string32", offsetof(SimVars, member), 32 },
+#define SIMVAR_ARRAY(member, count)
+#define SIMVAR_ELEMENT(member, index, name, units) { name, units, (int)(offsetof(SimVars, member) + index * sizeof(double)), sizeof(double) },
+#include "simvarSchema.h"
+#undef SIMVAR
+#undef SIMVAR_STRING
+#undef SIMVAR_ARRAY
+#undef SIMVAR_ELEMENT
+    { NULL, NULL, 0, 0 }
+};
+
 WriteEvent WriteEvents[] = {
     { SIM_START, "DUMMY" },
     { KEY_CABIN_SEATBELTS_ALERT_SWITCH_TOGGLE, "CABIN_SEATBELTS_ALERT_SWITCH_TOGGLE" },
@@ -397,3 +241,69 @@ WriteEvent WriteEvents[] = {
     { VJOY_BUTTONS_END, "VJOY_BUTTONS_END" },
     { SIM_STOP, NULL }
 };
+
+/// <summary>
+/// FNV-1a hash of a field's name and units
+/// </summary>
+unsigned int fieldHash(const char* name, const char* units)
+{
+    unsigned int hash = 2166136261u;
+    for (const char* ch = name; *ch != '\0'; ch++) {
+        hash = (hash ^ (unsigned char)*ch) * 16777619u;
+    }
+
+    // Keep name and units apart
+    hash = (hash ^ ':') * 16777619u;
+
+    for (const char* ch = units; *ch != '\0'; ch++) {
+        hash = (hash ^ (unsigned char)*ch) * 16777619u;
+    }
+
+    return hash;
+}
+
+/// <summary>
+/// Describe every field after connected. Returns the number of fields.
+/// </summary>
+int schemaEntries(SchemaEntry* entries)
+{
+    int count = 0;
+    for (; SimVarSchema[count].name != NULL && count < MaxFields - 1; count++) {
+        entries[count].fieldHash = fieldHash(SimVarSchema[count].name, SimVarSchema[count].units);
+        entries[count].size = SimVarSchema[count].size;
+    }
+
+    return count;
+}
+
+/// <summary>
+/// 64 bit FNV-1a hash of a schema
+/// </summary>
+unsigned long long layoutHash(const SchemaEntry* entries, int count)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < count; i++) {
+        unsigned int words[2] = { entries[i].fieldHash, (unsigned int)entries[i].size };
+        const unsigned char* bytes = (const unsigned char*)words;
+        for (int byte = 0; byte < (int)sizeof(words); byte++) {
+            hash = (hash ^ bytes[byte]) * 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+/// <summary>
+/// Layout hash of our own schema
+/// </summary>
+unsigned long long layoutHash()
+{
+    static unsigned long long hash = 0;
+
+    if (hash == 0) {
+        SchemaEntry entries[MaxFields];
+        hash = layoutHash(entries, schemaEntries(entries));
+    }
+
+    return hash;
+}
@@ -3,182 +3,53 @@
 
 #include <stdio.h>
 
+/// <summary>
+/// Fields come from the schema (see simvarSchema.h)
+/// </summary>
 struct SimVars
 {
     double connected = 0;
 
-    // All Jetbridge vars must come first
-    double apuMasterSw = 0;
-    double apuBleed = 0;
-    double elecBat1 = 0;
-    double elecBat2 = 0;
-    double jbManagedSpeed = 0;
-    double jbManagedHeading = 0;
-    double jbManagedAltitude = 0;
-    double jbLateralMode = 0;
-    double jbVerticalMode = 0;
-    double jbLocMode = 0;
-    double jbApprMode = 0;
-    double jbAutothrustMode = 0;
-    double jbShowMach = 0;
-    double jbAutobrake = 0;
-    double jbPitchTrim = 0;
-    double jbTcasMode = 0;
-    double sbEncoder[4];    // SwitchBox
-    double sbButton[7];     // SwitchBox
-    double sbMode;          // SwitchBox
-    double sbParkBrake;     // SwitchBox
-
-    // Vars required for all panels (screensaver, aircraft identification etc.)
-    char aircraft[32] = "\0";
-    double cruiseSpeed = 120;
-    double dcVolts = 23.7;
-    double batteryLoad = 0;
-
-    // Vars for Power/Lights panel
-    double lightStates = 0;
-    double tfFlapsCount = 1;
-    double tfFlapsIndex = 0;
-    double parkingBrakeOn = 1;
-    double pushbackState = 3;
-    double apuStartSwitch = 0;
-    double apuPercentRpm = 0;
+#define SIMVAR(member, name, units, init) double member = init;
+#define SIMVAR_STRING(member, name) char member[32] = "\0";
+#define SIMVAR_ARRAY(member, count) double member[count] = {};
+#define SIMVAR_ELEMENT(member, index, name, units)
+#include "simvarSchema.h"
+#undef SIMVAR
+#undef SIMVAR_STRING
+#undef SIMVAR_ARRAY
+#undef SIMVAR_ELEMENT
+};
 
-    // Vars for Radio panel
-    double com1Status = 0;
-    double com1Transmit = 1;
-    double com1Freq = 119.225;
-    double com1Standby = 124.850;
-    double nav1Freq = 110.50;
-    double nav1Standby = 113.90;
-    double com2Status = 0;
-    double com2Transmit = 0;
-    double com2Freq = 124.850;
-    double com2Standby = 124.850;
-    double nav2Freq = 110.50;
-    double nav2Standby = 113.90;
-    double com1Receive = 1;
-    double com2Receive = 0;
-    double adfFreq = 394;
-    double adfStandby = 368;
-    double com1Volume = 0;
-    double com2Volume = 0;
-    double seatBeltsSwitch = 0;
-    double transponderState = 0;
-    double transponderCode = 4608;
-    // No vars after here required by Radio panel
+/// <summary>
+/// Where each field after connected lives in SimVars. Built from the
+/// schema so offsets are never maintained by hand. Ends with a NULL
+/// name.
+/// </summary>
+struct SchemaField {
+    const char* name;
+    const char* units;
+    int offset;
+    int size;
+};
 
-    // Vars for Autopilot panel
-    double altAltitude = 0;
-    double asiAirspeed = 0;
-    double asiMachSpeed = 0;
-    double hiHeading = 0;
-    double vsiVerticalSpeed = 0;
-    double autopilotAvailable = 1;
-    double autopilotEngaged = 0;
-    double flightDirectorActive = 0;
-    double autopilotHeading = 0;
-    double autopilotHeadingLock = 0;
-    double autopilotHeadingSlotIndex = 1;
-    double autopilotLevel = 0;
-    double autopilotAltitude = 0;
-    double autopilotAltitude3 = 0;
-    double autopilotAltLock = 0;
-    double autopilotNav1Lock = 0;
-    double gpsDrivesNav1 = 0;
-    double autopilotPitchHold = 0;
-    double autopilotVerticalSpeed = 0;
-    double autopilotVerticalHold = 0;
-    double autopilotVsSlotIndex = 1;
-    double autopilotAirspeed = 0;
-    double autopilotMach = 0;
-    double autopilotAirspeedHold = 0;
-    double autopilotApproachHold = 0;
-    double autopilotGlideslopeHold = 0;
-    double throttlePosition = 0;
-    double autothrottleActive = 0;
-    // No vars after here required by Autopilot panel
+extern const SchemaField SimVarSchema[];
 
-    double altKollsman = 29.92;
-    double adiPitch = 0;
-    double adiBank = 0;
-    double asiTrueSpeed = 0;
-    double asiAirspeedCal = -14;
-    double hiHeadingTrue = 0;
-    double altAboveGround = 0;
-    double tcRate = 0;
-    double tcBall = 0;
-    double tfElevatorTrim = 0;
-    double tfRudderTrim = 0;
-    double tfSpoilersPosition = 0;
-    double tfAutoBrake = 0;
-    double dcUtcSeconds = 43200;
-    double dcLocalSeconds = 46800;
-    double dcFlightSeconds = 0;
-    double dcTempC = 26.2;
-    double numberOfEngines = 1;
-    double rpmEngine = 0;
-    double rpmPercent = 0;
-    double rpmElapsedTime = 0;
-    double fuelCapacity = 50;
-    double fuelQuantity = 0;
-    double fuelLeftPercent = 0;
-    double fuelRightPercent = 0;
-    double vor1Obs = 0;
-    double vor1RadialError = 0;
-    double vor1GlideSlopeError = 0;
-    double vor1ToFrom = 0;
-    double vor1GlideSlopeFlag = 0;
-    double vor2Obs = 0;
-    double vor2RadialError = 0;
-    double vor2ToFrom = 0;
-    double navHasLocalizer = 0;
-    double navLocalizer = 0;
-    double gpsWpCrossTrk = 0;
-    double adfRadial = 0;
-    double adfCard = 0;
-    double gearRetractable = 1;
-    double gearLeftPos = 100;
-    double gearCentrePos = 100;
-    double gearRightPos = 100;
-    double rudderPosition = 0;
-    double brakeLeftPedal = 0;
-    double brakeRightPedal = 0;
-    double oilTemp1 = 0;
-    double oilTemp2 = 0;
-    double oilTemp3 = 0;
-    double oilTemp4 = 0;
-    double oilPressure1 = 0;
-    double oilPressure2 = 0;
-    double oilPressure3 = 0;
-    double oilPressure4 = 0;
-    double exhaustGasTemp1 = 0;
-    double exhaustGasTemp2 = 0;
-    double exhaustGasTemp3 = 0;
-    double exhaustGasTemp4 = 0;
-    double engineType = 0;
-    double engineMaxRpm = 0;
-    double turbineEngine1N1 = 0;
-    double turbineEngine2N1 = 0;
-    double turbineEngine3N1 = 0;
-    double turbineEngine4N1 = 0;
-    double propRpm = 0;
-    double engineManifoldPressure = 0;
-    double engineFuelFlow1 = 0;
-    double engineFuelFlow2 = 0;
-    double engineFuelFlow3 = 0;
-    double engineFuelFlow4 = 0;
-    double suctionPressure = 1;
-    double onGround = 0;
-    double gForce = 0;
-    char atcTailNumber[32] = "\0";
-    char atcCallSign[32] = "\0";
-    char atcFlightNumber[32] = "\0";
-    double atcHeavy = 0;
-    double landingRate = -999;
-    double skytrackState = 0;
+/// <summary>
+/// A field as it is described to the other end of the data link: a
+/// hash of its name and units plus its size. The layout hash covers
+/// every entry in order so it changes if a field is added, removed,
+/// moved, renamed or changes units.
+/// </summary>
+struct SchemaEntry {
+    unsigned int fieldHash;
+    int size;
 };
 
+int schemaEntries(SchemaEntry* entries);
+unsigned long long layoutHash(const SchemaEntry* entries, int count);
+unsigned long long layoutHash();
+
 enum EVENT_ID {
     SIM_START,
     KEY_CABIN_SEATBELTS_ALERT_SWITCH_TOGGLE,
@@ -399,6 +270,8 @@ struct WriteEvent {
 
 struct WriteData {
     EVENT_ID eventId;
+    int repeat;     // Number of times to send the event (0 = once), only
+                    // used with a data link that acks reliable writes
     double value;
 };
 
@@ -408,10 +281,124 @@ struct PosData {
     double heading;
 };
 
+/// <summary>
+/// SimVars are numbered as fields. Field 0 is connected and field n
+/// is SimVarSchema[n - 1]. Each field is a double apart from string32
+/// which is 32 chars.
+/// </summary>
+const int MaxFields = 256;
+const int FieldWords = MaxFields / 32;
+
+/// <summary>
+/// Range of SimVars a panel uses, from first to last inclusive
+/// (as byte offsets into SimVars).
+/// </summary>
+struct SimVarRange {
+    int first;
+    int last;
+};
+
+/// <summary>
+/// Every data request carries a sequence number and the sequence
+/// number of the last frame the client applied (its baseline).
+/// The server replies with a FrameHeader followed by either full
+/// data (baseline = 0) or a delta against the acknowledged baseline.
+///
+/// Only the fields set in the fields bitmap are sent. Full data is
+/// packed in field order and requestedSize is the packed size. Delta
+/// offsets are still SimVars offsets.
+///
+/// A client can ask for compact full data and deltas (see framecodec).
+/// The server may still send raw data so the FrameHeader says which it is.
+///
+/// Every request carries the client's layout hash. If it doesn't match
+/// the server's, the server answers with its schema instead (a
+/// SchemaEntry for every field after connected). The client then asks
+/// for the fields both have in common, numbered and laid out the way
+/// the server has them, and sends the server's layout hash.
+/// </summary>
+enum FrameEncoding {
+    ENCODING_RAW,
+    ENCODING_COMPACT,
+    ENCODING_ACK,       // No data, acknowledges reliable writes
+    ENCODING_SCHEMA,    // Server schema, request had a different layout hash
+    ENCODING_LAYOUT     // Hub only, layout of the panel sending it (see simvars.cpp)
+};
+
 struct Request {
     int requestedSize;
     int wantFullData;
     WriteData writeData;
+    int seq;
+    int baseline;
+    unsigned int fields[FieldWords];
+    int encoding;               // Encoding the client wants
+    unsigned int stringHash;    // Strings the client already has
+    unsigned long long layoutHash;  // Field layout the client expects
+};
+
+/// <summary>
+/// Instead of requesting every frame a client can ask the server to
+/// push them. A StreamRequest is a Request plus the frames per second
+/// wanted (0 stops the stream). The server answers it straight away,
+/// with seq set to the request seq if that is higher than any frame it
+/// has pushed, then pushes a frame whenever anything has changed (at
+/// most rate times a second and at least once a second). Each frame is
+/// a delta against the one pushed before it, or full data if the
+/// request asked for it. If the client missed a frame it sets resync
+/// and the answer is a delta against the request baseline instead.
+/// The client resends its StreamRequest as a keepalive and the server
+/// stops if it hears nothing for StreamTimeoutMs.
+/// </summary>
+const int StreamTimeoutMs = 3000;
+
+struct StreamRequest {
+    Request request;
+    int rate;
+    int resync;
+};
+
+/// <summary>
+/// Events are written in batches. A batch has requestedSize set to
+/// sizeof(WriteData) and the number of events where wantFullData
+/// would be, so the first event is where a single write expects it.
+/// </summary>
+const int MaxWriteBatch = 32;
+
+struct WriteBatch {
+    int requestedSize;
+    int writeCount = 0;
+    WriteData writeData[MaxWriteBatch];
+};
+
+/// <summary>
+/// Events can also be written reliably. A reliable batch has
+/// requestedSize set to sizeof(ReliableWrite) and every event has a
+/// writeSeq one higher than the one before. The client resends events
+/// until they are acknowledged so the server must apply each writeSeq
+/// once and in order, ignoring any it has already applied and anything
+/// after a gap. It acknowledges with a FrameHeader (and no data) with
+/// encoding ENCODING_ACK, seq set to the batch session and baseline set
+/// to the last writeSeq applied. A new session starts from writeSeq 1.
+/// A server that acknowledges must also honour WriteData::repeat as
+/// the client only starts combining increments once it sees an ack.
+/// </summary>
+struct ReliableWrite {
+    int writeSeq;
+    WriteData writeData;
+};
+
+struct ReliableBatch {
+    int requestedSize;
+    int writeCount = 0;
+    int session;
+    ReliableWrite writes[MaxWriteBatch];
+};
+
+struct FrameHeader {
+    int seq;        // Sequence number of the request being answered
+    int baseline;   // Frame the delta applies to, 0 = full data
+    int encoding;   // Encoding of full data or delta
 };
 
 struct DeltaDouble {
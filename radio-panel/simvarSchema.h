@@ -0,0 +1,197 @@
+// SimVars schema, the one place a field is defined. Included several
+// times with SIMVAR, SIMVAR_STRING, SIMVAR_ARRAY and SIMVAR_ELEMENT
+// defined to build the SimVars struct, the SimVarDefs table and the
+// SimVarSchema layout (see simvarDefs.h). Fields travel in this order
+// so adding, removing or moving one changes the layout hash.
+//
+// SIMVAR(member, name, units, initial value)
+// SIMVAR_STRING(member, name)                  32 chars
+// SIMVAR_ARRAY(member, count)                  array of doubles...
+// SIMVAR_ELEMENT(member, index, name, units)   ...and each element
+//
+// No include guard as it is meant to be included more than once.
+
+// All Jetbridge vars must come first
+SIMVAR(apuMasterSw, "Apu Master Sw", "jetbridge", 0)
+SIMVAR(apuBleed, "Apu Bleed", "jetbridge", 0)
+SIMVAR(elecBat1, "Elec Bat1", "jetbridge", 0)
+SIMVAR(elecBat2, "Elec Bat2", "jetbridge", 0)
+SIMVAR(jbManagedSpeed, "Autopilot Managed Speed", "jetbridge", 0)
+SIMVAR(jbManagedHeading, "Autopilot Managed Heading", "jetbridge", 0)
+SIMVAR(jbManagedAltitude, "Autopilot Managed Altitude", "jetbridge", 0)
+SIMVAR(jbLateralMode, "Lateral Mode", "jetbridge", 0)
+SIMVAR(jbVerticalMode, "Vertical Mode", "jetbridge", 0)
+SIMVAR(jbLocMode, "Loc Mode", "jetbridge", 0)
+SIMVAR(jbApprMode, "Appr Mode", "jetbridge", 0)
+SIMVAR(jbAutothrustMode, "Autothrust Mode", "jetbridge", 0)
+SIMVAR(jbShowMach, "Show Mach", "jetbridge", 0)
+SIMVAR(jbAutobrake, "Autobrake Armed", "jetbridge", 0)
+SIMVAR(jbPitchTrim, "Pitch Trim", "jetbridge", 0)
+SIMVAR(jbTcasMode, "Tcas Mode", "jetbridge", 0)
+SIMVAR_ARRAY(sbEncoder, 4)
+SIMVAR_ELEMENT(sbEncoder, 0, "SwitchBox Encoder 1", "jetbridge")
+SIMVAR_ELEMENT(sbEncoder, 1, "SwitchBox Encoder 2", "jetbridge")
+SIMVAR_ELEMENT(sbEncoder, 2, "SwitchBox Encoder 3", "jetbridge")
+SIMVAR_ELEMENT(sbEncoder, 3, "SwitchBox Encoder 4", "jetbridge")
+SIMVAR_ARRAY(sbButton, 7)
+SIMVAR_ELEMENT(sbButton, 0, "SwitchBox Button 1", "jetbridge")
+SIMVAR_ELEMENT(sbButton, 1, "SwitchBox Button 2", "jetbridge")
+SIMVAR_ELEMENT(sbButton, 2, "SwitchBox Button 3", "jetbridge")
+SIMVAR_ELEMENT(sbButton, 3, "SwitchBox Button 4", "jetbridge")
+SIMVAR_ELEMENT(sbButton, 4, "SwitchBox Button 5", "jetbridge")
+SIMVAR_ELEMENT(sbButton, 5, "SwitchBox Button 6", "jetbridge")
+SIMVAR_ELEMENT(sbButton, 6, "SwitchBox Button 7", "jetbridge")
+SIMVAR(sbMode, "SwitchBox Mode", "jetbridge", 0)
+SIMVAR(sbParkBrake, "SwitchBox Park Brake", "jetbridge", 0)
+
+// Vars required for all panels (screensaver, aircraft identification etc.)
+SIMVAR_STRING(aircraft, "Title")
+SIMVAR(cruiseSpeed, "Estimated Cruise Speed", "knots", 120)
+SIMVAR(dcVolts, "Electrical Main Bus Voltage", "volts", 23.7)
+SIMVAR(batteryLoad, "Electrical Battery Load", "amperes", 0)
+
+// Vars for Power/Lights panel
+SIMVAR(lightStates, "Light On States", "mask", 0)
+SIMVAR(tfFlapsCount, "Flaps Num Handle Positions", "number", 1)
+SIMVAR(tfFlapsIndex, "Flaps Handle Index", "number", 0)
+SIMVAR(parkingBrakeOn, "Brake Parking Position", "bool", 1)
+SIMVAR(pushbackState, "Pushback State", "enum", 3)
+SIMVAR(apuStartSwitch, "Apu Switch", "bool", 0)
+SIMVAR(apuPercentRpm, "Apu Pct Rpm", "percent", 0)
+
+// Vars for Radio panel
+SIMVAR(com1Status, "Com Status:1", "enum", 0)
+SIMVAR(com1Transmit, "Com Transmit:1", "bool", 1)
+SIMVAR(com1Freq, "Com Active Frequency:1", "mhz", 119.225)
+SIMVAR(com1Standby, "Com Standby Frequency:1", "mhz", 124.850)
+SIMVAR(nav1Freq, "Nav Active Frequency:1", "mhz", 110.50)
+SIMVAR(nav1Standby, "Nav Standby Frequency:1", "mhz", 113.90)
+SIMVAR(com2Status, "Com Status:2", "enum", 0)
+SIMVAR(com2Transmit, "Com Transmit:2", "bool", 0)
+SIMVAR(com2Freq, "Com Active Frequency:2", "mhz", 124.850)
+SIMVAR(com2Standby, "Com Standby Frequency:2", "mhz", 124.850)
+SIMVAR(nav2Freq, "Nav Active Frequency:2", "mhz", 110.50)
+SIMVAR(nav2Standby, "Nav Standby Frequency:2", "mhz", 113.90)
+SIMVAR(com1Receive, "Com Receive:1", "bool", 1)
+SIMVAR(com2Receive, "Com Receive:2", "bool", 0)
+SIMVAR(adfFreq, "Adf Active Frequency:1", "khz", 394)
+SIMVAR(adfStandby, "Adf Standby Frequency:1", "khz", 368)
+SIMVAR(com1Volume, "Com Volume:1", "percent", 0)
+SIMVAR(com2Volume, "Com Volume:2", "percent", 0)
+SIMVAR(seatBeltsSwitch, "Cabin Seatbelts Alert Switch", "bool", 0)
+SIMVAR(transponderState, "Transponder State:1", "enum", 0)
+SIMVAR(transponderCode, "Transponder Code:1", "bco16", 4608)
+// No vars after here required by Radio panel
+
+// Vars for Autopilot panel
+SIMVAR(altAltitude, "Indicated Altitude", "feet", 0)
+SIMVAR(asiAirspeed, "Airspeed Indicated", "knots", 0)
+SIMVAR(asiMachSpeed, "Airspeed Mach", "mach", 0)
+SIMVAR(hiHeading, "Plane Heading Degrees Magnetic", "degrees", 0)
+SIMVAR(vsiVerticalSpeed, "Vertical Speed", "feet per second", 0)
+SIMVAR(autopilotAvailable, "Autopilot Available", "bool", 1)
+SIMVAR(autopilotEngaged, "Autopilot Master", "bool", 0)
+SIMVAR(flightDirectorActive, "Autopilot Flight Director Active", "bool", 0)
+SIMVAR(autopilotHeading, "Autopilot Heading Lock Dir", "degrees", 0)
+SIMVAR(autopilotHeadingLock, "Autopilot Heading Lock", "bool", 0)
+SIMVAR(autopilotHeadingSlotIndex, "Autopilot Heading Slot Index", "number", 1)
+SIMVAR(autopilotLevel, "Autopilot Wing Leveler", "bool", 0)
+SIMVAR(autopilotAltitude, "Autopilot Altitude Lock Var", "feet", 0)
+SIMVAR(autopilotAltitude3, "Autopilot Altitude Lock Var:3", "feet", 0)
+SIMVAR(autopilotAltLock, "Autopilot Altitude Lock", "bool", 0)
+SIMVAR(autopilotNav1Lock, "Autopilot Nav1 Lock", "bool", 0)
+SIMVAR(gpsDrivesNav1, "Gps Drives Nav1", "bool", 0)
+SIMVAR(autopilotPitchHold, "Autopilot Pitch Hold", "bool", 0)
+SIMVAR(autopilotVerticalSpeed, "Autopilot Vertical Hold Var", "feet/minute", 0)
+SIMVAR(autopilotVerticalHold, "Autopilot Vertical Hold", "bool", 0)
+SIMVAR(autopilotVsSlotIndex, "Autopilot VS Slot Index", "number", 1)
+SIMVAR(autopilotAirspeed, "Autopilot Airspeed Hold Var", "knots", 0)
+SIMVAR(autopilotMach, "Autopilot Mach Hold Var", "number", 0)
+SIMVAR(autopilotAirspeedHold, "Autopilot Airspeed Hold", "bool", 0)
+SIMVAR(autopilotApproachHold, "Autopilot Approach Hold", "bool", 0)
+SIMVAR(autopilotGlideslopeHold, "Autopilot Glideslope Hold", "bool", 0)
+SIMVAR(throttlePosition, "General Eng Throttle Lever Position:1", "percent", 0)
+SIMVAR(autothrottleActive, "Autothrottle Active", "bool", 0)
+// No vars after here required by Autopilot panel
+
+// Remaining vars for Instrument panel
+SIMVAR(altKollsman, "Kohlsman Setting Hg", "inHg", 29.92)
+SIMVAR(adiPitch, "Attitude Indicator Pitch Degrees", "degrees", 0)
+SIMVAR(adiBank, "Attitude Indicator Bank Degrees", "degrees", 0)
+SIMVAR(asiTrueSpeed, "Airspeed True", "knots", 0)
+SIMVAR(asiAirspeedCal, "Airspeed True Calibrate", "degrees", -14)
+SIMVAR(hiHeadingTrue, "Plane Heading Degrees True", "degrees", 0)
+SIMVAR(altAboveGround, "Plane Alt Above Ground", "feet", 0)
+SIMVAR(tcRate, "Turn Indicator Rate", "degrees per second", 0)
+SIMVAR(tcBall, "Turn Coordinator Ball", "position", 0)
+SIMVAR(tfElevatorTrim, "Elevator Trim Position", "degrees", 0)
+SIMVAR(tfRudderTrim, "Rudder Trim Pct", "percent", 0)
+SIMVAR(tfSpoilersPosition, "Spoilers Handle Position", "percent", 0)
+SIMVAR(tfAutoBrake, "Auto Brake Switch Cb", "number", 0)
+SIMVAR(dcUtcSeconds, "Zulu Time", "seconds", 43200)
+SIMVAR(dcLocalSeconds, "Local Time", "seconds", 46800)
+SIMVAR(dcFlightSeconds, "Absolute Time", "seconds", 0)
+SIMVAR(dcTempC, "Ambient Temperature", "celsius", 26.2)
+SIMVAR(numberOfEngines, "Number Of Engines", "number", 1)
+SIMVAR(rpmEngine, "General Eng Rpm:1", "rpm", 0)
+SIMVAR(rpmPercent, "Eng Rpm Animation Percent:1", "percent", 0)
+SIMVAR(rpmElapsedTime, "General Eng Elapsed Time:1", "hours", 0)
+SIMVAR(fuelCapacity, "Fuel Total Capacity", "gallons", 50)
+SIMVAR(fuelQuantity, "Fuel Total Quantity", "gallons", 0)
+SIMVAR(fuelLeftPercent, "Fuel Tank Left Main Level", "percent", 0)
+SIMVAR(fuelRightPercent, "Fuel Tank Right Main Level", "percent", 0)
+SIMVAR(vor1Obs, "Nav Obs:1", "degrees", 0)
+SIMVAR(vor1RadialError, "Nav Radial Error:1", "degrees", 0)
+SIMVAR(vor1GlideSlopeError, "Nav Glide Slope Error:1", "degrees", 0)
+SIMVAR(vor1ToFrom, "Nav ToFrom:1", "enum", 0)
+SIMVAR(vor1GlideSlopeFlag, "Nav Gs Flag:1", "bool", 0)
+SIMVAR(vor2Obs, "Nav Obs:2", "degrees", 0)
+SIMVAR(vor2RadialError, "Nav Radial Error:2", "degrees", 0)
+SIMVAR(vor2ToFrom, "Nav ToFrom:2", "enum", 0)
+SIMVAR(navHasLocalizer, "Nav Has Localizer:1", "bool", 0)
+SIMVAR(navLocalizer, "Nav Localizer:1", "degrees", 0)
+SIMVAR(gpsWpCrossTrk, "Gps Wp Cross Trk", "meters", 0)
+SIMVAR(adfRadial, "Adf Radial:1", "degrees", 0)
+SIMVAR(adfCard, "Adf Card", "degrees", 0)
+SIMVAR(gearRetractable, "Is Gear Retractable", "bool", 1)
+SIMVAR(gearLeftPos, "Gear Left Position", "percent", 100)
+SIMVAR(gearCentrePos, "Gear Center Position", "percent", 100)
+SIMVAR(gearRightPos, "Gear Right Position", "percent", 100)
+SIMVAR(rudderPosition, "Rudder Position", "position", 0)
+SIMVAR(brakeLeftPedal, "Brake Left Position", "percent", 0)
+SIMVAR(brakeRightPedal, "Brake Right Position", "percent", 0)
+SIMVAR(oilTemp1, "General Eng Oil Temperature:1", "fahrenheit", 0)
+SIMVAR(oilTemp2, "General Eng Oil Temperature:2", "fahrenheit", 0)
+SIMVAR(oilTemp3, "General Eng Oil Temperature:3", "fahrenheit", 0)
+SIMVAR(oilTemp4, "General Eng Oil Temperature:4", "fahrenheit", 0)
+SIMVAR(oilPressure1, "General Eng Oil Pressure:1", "psi", 0)
+SIMVAR(oilPressure2, "General Eng Oil Pressure:2", "psi", 0)
+SIMVAR(oilPressure3, "General Eng Oil Pressure:3", "psi", 0)
+SIMVAR(oilPressure4, "General Eng Oil Pressure:4", "psi", 0)
+SIMVAR(exhaustGasTemp1, "General Eng Exhaust Gas Temperature:1", "celsius", 0)
+SIMVAR(exhaustGasTemp2, "General Eng Exhaust Gas Temperature:2", "celsius", 0)
+SIMVAR(exhaustGasTemp3, "General Eng Exhaust Gas Temperature:3", "celsius", 0)
+SIMVAR(exhaustGasTemp4, "General Eng Exhaust Gas Temperature:4", "celsius", 0)
+SIMVAR(engineType, "Engine Type", "enum", 0)
+SIMVAR(engineMaxRpm, "Max Rated Engine RPM", "rpm", 0)
+SIMVAR(turbineEngine1N1, "Turb Eng N1:1", "percent", 0)
+SIMVAR(turbineEngine2N1, "Turb Eng N1:2", "percent", 0)
+SIMVAR(turbineEngine3N1, "Turb Eng N1:3", "percent", 0)
+SIMVAR(turbineEngine4N1, "Turb Eng N1:4", "percent", 0)
+SIMVAR(propRpm, "Prop RPM:1", "rpm", 0)
+SIMVAR(engineManifoldPressure, "Eng Manifold Pressure:1", "inches of mercury", 0)
+SIMVAR(engineFuelFlow1, "Eng Fuel Flow GPH:1", "gallons per hour", 0)
+SIMVAR(engineFuelFlow2, "Eng Fuel Flow GPH:2", "gallons per hour", 0)
+SIMVAR(engineFuelFlow3, "Eng Fuel Flow GPH:3", "gallons per hour", 0)
+SIMVAR(engineFuelFlow4, "Eng Fuel Flow GPH:4", "gallons per hour", 0)
+SIMVAR(suctionPressure, "Suction Pressure", "inches of mercury", 1)
+SIMVAR(onGround, "Sim On Ground", "bool", 0)
+SIMVAR(gForce, "G Force", "gforce", 0)
+SIMVAR_STRING(atcTailNumber, "Atc Id")
+SIMVAR_STRING(atcCallSign, "Atc Airline")
+SIMVAR_STRING(atcFlightNumber, "Atc Flight Number")
+SIMVAR(atcHeavy, "Atc Heavy", "bool", 0)
+
+// Internal variables must come last
+SIMVAR(landingRate, "Landing Rate", "internal", -999)
+SIMVAR(skytrackState, "Skytrack State", "internal", 0)
@@ -1,35 +1,412 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <signal.h>
 #include "settings.h"
 #include "simvars.h"
+#include "framecodec.h"
+#include "framediff.h"
+#include "capture.h"
+#include "sharedvars.h"
 
 const char *DataLinkGroup = "Data Link";
-char dataLinkHost[64];
+const int NewFrameBit = 4;
+const long long InFlightTimeoutNs = 500000000LL;
+const long long ActivityHoldoffNs = 100000000LL;
+
+// Link is suspect (and probed at the boost rate) if a request goes
+// unanswered for several times the RTT p99 and lost if there is still
+// no response a while later. Reconnects back off with jitter.
+const int SuspectRttMultiple = 4;
+const int LostRttMultiple = 16;
+const int MinRttSamples = 8;
+const long long DefaultRttNs = 125000000LL;
+const long long MinSuspectNs = 100000000LL;
+const long long MinLostNs = 2000000000LL;
+const long long MinReconnectNs = 100000000LL;
+const long long MaxReconnectNs = 2000000000LL;
+char dataLinkHost[256];
 int dataLinkPort;
-extern const char* SimVarDefs[][2];
+SOCKET sockfd = INVALID_SOCKET;
+
+// Host can list several data links (host or host:port, comma
+// separated). They are all probed at startup, on link loss and when
+// the active one is suspect or its sim is not connected.
+const int MaxEndpoints = 8;
+const long long SelectWindowNs = 100000000LL;
+const int StickyRttMultiple = 2;
+const long long StickyRttNs = 2000000LL;
+
+struct Endpoint {
+    char name[64];
+    sockaddr_in addr;
+    long long probeNs;      // When last probed
+    long long rttNs;        // Round trip time of last probe
+    bool answered;          // Answered last probe
+    bool connected;         // Sim was connected at last probe
+};
+Endpoint endpoints[MaxEndpoints];
+int endpointCount = 0;
+std::atomic<int> activeEndpoint(0);
+bool probing = false;
+long long selectByNs = 0;
+long long chosenNs = 0;
+
+// Data links are also found by broadcasting a probe on every local
+// network whenever there is no link. Host "auto" (or no Host) looks
+// straight away, otherwise we only look once the listed hosts have had
+// a round to answer. Only answers to the latest discovery are taken
+// and only until there is a link. The last data link used is
+// remembered and asked first next time.
+const char* CacheFile = "last-data-link.txt";
+const int MaxInterfaces = 16;
+bool discovering = true;
+int discoverRounds = 1;     // Unanswered rounds before we look (0 = straight away)
+int unansweredRounds = 0;
+bool discoveryOpen = false;
+int discoverSeq = 0;
+long long discoverNs = 0;
+char cachedEndpoint[64] = "";
+in_addr localAddrs[MaxInterfaces];
+in_addr broadcastAddrs[MaxInterfaces];
+int localCount = 0;
+int broadcastCount = 0;
+sockaddr_in batchAddrs[8];
 bool prevConnected = false;
 int dataSize;
 Request request;
-char deltaData[8192];
-int nextFull = 0;
+
+// Subscribed SimVars (adjacent fields merged)
+struct FieldSpan {
+    int offset;
+    int size;
+};
+FieldSpan spans[MaxFields];
+int spanCount = 0;
+
+// Field number at each 8 byte slot of SimVars (strings cover 4 slots)
+FieldDef fieldDefs[MaxFields];
+int slotField[SlotCount];
+
+// A data link built with a different schema sends us its own. We then
+// only use the fields it also has (in the same order), ask for them by
+// its field numbers and move raw deltas from its offsets to ours.
+const int MaxWireSlots = MaxFields * 4;
+unsigned int wantedFields[FieldWords];
+unsigned int activeFields[FieldWords];   // Wanted fields the data link has
+bool remapped = false;
+bool sizeWarned = false;
+int wireField[MaxFields];       // Data link field number of each of our fields (-1 = none)
+int localOffset[MaxWireSlots];  // Our offset of each data link slot (-1 = none)
+
+// Fields changed by the frame being published. Everything counts as
+// changed after a reset so the panel picks up the whole state again.
+unsigned int frameDirty[FieldWords];
+bool allDirty = true;
+framecodec codec;
+bool compactFrames;
+capture captureFile;
+bool capturing = false;
+bool replaying = false;
+int replaySpeed;
+const int BatchSize = sizeof(batchAddrs) / sizeof(sockaddr_in);
+FrameHeader batchHeaders[BatchSize];
+char batchData[BatchSize][8192];
+char captureData[8192];
+std::atomic<int> lastSentSeq(0);
+int lastAnsweredSeq = 0;
+int appliedSeq = 0;
+bool wantFull = true;
+long long suspectSinceNs = 0;
+long long lostAtNs = 0;
+long long reconnectNs;
+bool backingOff = false;
+
+// Hub mode lets several panels share one data link. The publisher
+// polls upstream as normal and multicasts every frame it publishes
+// (as a compact delta with a full keyframe every KeyframeNs) and
+// relays events written by subscribers upstream. Subscribers don't
+// poll, they just listen to the multicast group.
+enum HubMode {
+    HUB_NONE,
+    HUB_PUBLISH,
+    HUB_SUBSCRIBE
+};
+const long long KeyframeNs = 1000000000LL;
+const long long HubTimeoutNs = 3500000000LL;
+const int HubCheckRate = 4;
+HubMode hubMode = HUB_NONE;
+SOCKET hubfd = INVALID_SOCKET;
+sockaddr_in hubGroupAddr;
+int hubSeq = 0;
+long long lastKeyframeNs = 0;
+SimVars hubPrev;
+char hubFrame[8192];
+
+// Subscribers decode with our full layout, not the one negotiated with
+// the data link, so the hub has its own codec. Fields the data link
+// doesn't have keep their last value.
+framecodec hubCodec;
+
+// Publisher and subscribers only use each other if they were built
+// with the same SimVars. The publisher multicasts its layout before
+// every keyframe and each subscriber answers with its own, which is
+// how the publisher knows whose events to relay.
+struct HubLayout {
+    int simVarsSize;
+    unsigned long long layoutHash;
+};
+
+struct HubSubscriber {
+    sockaddr_in addr;
+    long long lastNs;
+};
+
+const int MaxHubSubscribers = 16;
+HubSubscriber hubSubscribers[MaxHubSubscribers];
+int hubSubscriberCount = 0;
+bool hubLayoutOk = false;
+bool hubLayoutWarned = false;
+
+// Shared memory lets several panel processes on one machine share a
+// data link. The owner runs the data link as normal and writes every
+// frame it publishes to the segment. Attached processes never poll,
+// they just copy SimVars out of the segment whenever it changes.
+enum SharedMode {
+    SHARED_NONE,
+    SHARED_PUBLISH,
+    SHARED_ATTACH
+};
+const long long SharedWaitNs = 250000000LL;
+SharedMode sharedMode = SHARED_NONE;
+sharedvars sharedVars;
+char sharedName[256] = "/radio-panel";
+
+// Stream mode asks the server to push frames at the poll rate instead
+// of polling for each one. The StreamRequest is only resent as a
+// keepalive, when the rate changes or when full data is needed. Its
+// seq is kept above any frame received so the answer can be timed.
+const long long StreamKeepaliveNs = 500000000LL;
+const long long StreamResyncNs = 100000000LL;
+const int StreamSeqGap = 16;
+bool streaming = false;
+bool streamResync = false;
+long streamRate = 0;
+long long keepaliveNs = 0;
+
+// Batches holding a trigger event (e.g. a swap) can be written
+// reliably. The main loop sends each one straight away and hands its
+// events to the data link thread (through a ring it only ever adds
+// to) which resends them until acknowledged, after a multiple of the
+// RTT p99 that doubles each time. A data link that doesn't support
+// them rejects the batch as a data size mismatch, after which events
+// are sent normally.
+const int MaxUnacked = 64;
+const int ResendRttMultiple = 2;
+const long long MinResendNs = 20000000LL;
+const long long MaxResendNs = 1000000000LL;
+const int MaxResends = 8;
+std::atomic<bool> reliableWrites(false);
+std::atomic<bool> repeatWrites(false);   // Data link honours WriteData::repeat
+bool reliableWarned = false;
+int writeSession;
+int writeSeq = 0;
+ReliableWrite handoff[MaxUnacked];
+std::atomic<int> handedOff(0);
+std::atomic<int> takenOff(0);
+ReliableWrite unacked[MaxUnacked];
+int unackedCount = 0;
+int ackedWriteSeq = 0;
+int resends = 0;
+long long resendNs = 0;
 
 void dataLink(simvars*);
+void sendUnreliable(simvars* thisPtr, long long nowNs);
+void subscribe(const SimVarRange* subscription);
+void useFields(const unsigned int* fieldBits);
+bool negotiate(const char* payload, int payloadSize);
+void addEndpoints(const char* hosts);
+void loadCachedEndpoint();
+void scanInterfaces();
+bool sameEndpoint(sockaddr_in* addr1, sockaddr_in* addr2);
+int endpointOf(sockaddr_in* addr);
+void openHub();
+int hubLayoutMessage(char* data);
+bool fieldsChanged(const unsigned int* dirty, int firstOffset, int lastOffset);
+long long monotonicNs();
+void loadAircraft();
 void identifyAircraft(char* aircraft);
-void receiveDelta(char* deltaData, int deltaSize, char* simVarsPtr);
 
-simvars::simvars()
+simvars::simvars(const SimVarRange* subscription)
 {
+    simVars = &buffers[frontIndex];
+    middle = 1;
+    memset(dirty, 0, sizeof(dirty));
+    memset(changedGeneration, 0, sizeof(changedGeneration));
+
+    strcpy(dataLinkHost, "auto");
     globals.allSettings->getString(DataLinkGroup, "Host", dataLinkHost);
-    if (dataLinkHost == NULL) {
-        strcpy(dataLinkHost, "127.0.0.1");
-    }
 
     dataLinkPort = globals.allSettings->getInt(DataLinkGroup, "Port");
     if (dataLinkPort == INT_MIN) {
         dataLinkPort = 52020;
     }
 
+    // Poll rate adapts to panel activity
+    int rate = globals.allSettings->getInt(DataLinkGroup, "Normal Rate");
+    if (rate > 0) {
+        globals.dataRateFps = rate;
+    }
+    boostRate = rateSetting("Boost Rate", 50);
+    idleRate = rateSetting("Idle Rate", 4);
+    disconnectedRate = rateSetting("Disconnected Rate", 1);
+    boostNs = rateSetting("Boost Seconds", 3) * 1000000000LL;
+    idleNs = rateSetting("Idle Seconds", 30) * 1000000000LL;
+    lastActivityNs = monotonicNs() - boostNs;
+
+    compactFrames = (globals.allSettings->getInt(DataLinkGroup, "Compact Frames") != 0);
+    loadAircraft();
+
+    if ((activityfd = eventfd(0, EFD_NONBLOCK)) == -1) {
+        printf("DataLink: Failed to create activity event\n");
+        exit(1);
+    }
+
+    // Create a non-blocking UDP socket shared by the data link
+    // thread and the main loop (for writing events).
+    if ((sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) == INVALID_SOCKET) {
+        printf("DataLink: Failed to create UDP socket\n");
+        exit(1);
+    }
+
+    int opt = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+
+    addEndpoints(dataLinkHost);
+    scanInterfaces();
+    loadCachedEndpoint();
+    setsockopt(sockfd, SOL_SOCKET, SO_BROADCAST, (char*)&opt, sizeof(opt));
+
+    char hub[16] = "";
+    globals.allSettings->getString(DataLinkGroup, "Hub", hub);
+    if (strcmp(hub, "publish") == 0) {
+        hubMode = HUB_PUBLISH;
+    }
+    else if (strcmp(hub, "subscribe") == 0) {
+        hubMode = HUB_SUBSCRIBE;
+    }
+    else if (*hub != '\0') {
+        printf("DataLink: Hub must be publish or subscribe\n");
+        exit(1);
+    }
+
+    char shared[16] = "";
+    globals.allSettings->getString(DataLinkGroup, "Shared Memory", shared);
+    if (strcmp(shared, "publish") == 0) {
+        sharedMode = SHARED_PUBLISH;
+    }
+    else if (strcmp(shared, "attach") == 0) {
+        sharedMode = SHARED_ATTACH;
+    }
+    else if (*shared != '\0') {
+        printf("DataLink: Shared Memory must be publish or attach\n");
+        exit(1);
+    }
+
+    if (sharedMode == SHARED_ATTACH && hubMode != HUB_NONE) {
+        printf("DataLink: Can't use a hub when attached to shared memory\n");
+        exit(1);
+    }
+
+    if (hubMode == HUB_NONE && sharedMode != SHARED_PUBLISH) {
+        subscribe(subscription);
+    }
+    else {
+        // Hub and shared memory carry everything so any panel can use them
+        subscribe(NULL);
+    }
+
+    if (hubMode != HUB_NONE) {
+        openHub();
+    }
+
+    if (sharedMode != SHARED_NONE) {
+        globals.allSettings->getString(DataLinkGroup, "Shared Memory Name", sharedName);
+    }
+
+    // Hub subscribers and attached panels don't send requests
+    streaming = globals.allSettings->getInt(DataLinkGroup, "Stream") > 0;
+    if (hubMode == HUB_SUBSCRIBE || sharedMode == SHARED_ATTACH) {
+        streaming = false;
+    }
+
+    // Acks would go to the hub or shared memory owner instead
+    reliableWrites = globals.allSettings->getInt(DataLinkGroup, "Reliable Writes") > 0;
+    if (hubMode == HUB_SUBSCRIBE || sharedMode == SHARED_ATTACH) {
+        reliableWrites = false;
+    }
+    writeSession = ((getpid() << 16) ^ monotonicNs()) & INT_MAX;
+
+    if (sharedMode == SHARED_PUBLISH) {
+        sharedVars.create(sharedName);
+        printf("Publishing to shared memory %s\n", sharedName);
+    }
+    else if (sharedMode == SHARED_ATTACH) {
+        // Events go to the owner's data link (see attachShared)
+        endpointCount = 1;
+        discovering = false;
+        snprintf(endpoints[0].name, sizeof(endpoints[0].name), "shared memory %.49s", sharedName);
+    }
+
+    // Can capture everything sent and received or replay a capture
+    // instead of connecting to the data link.
+    char captureFilename[256] = "";
+    globals.allSettings->getString(DataLinkGroup, "Replay File", captureFilename);
+    if (*captureFilename != '\0') {
+        CaptureHeader* header = captureFile.openRead(captureFilename);
+        if (header->simVarsSize != sizeof(SimVars)) {
+            printf("DataLink: %s was captured with different SimVars\n", captureFilename);
+            exit(1);
+        }
+        useFields(header->fields);
+        replaySpeed = globals.allSettings->getInt(DataLinkGroup, "Replay Speed");
+        if (replaySpeed == INT_MIN) {
+            replaySpeed = 1;
+        }
+        replaying = true;
+        printf("Replaying %s\n", captureFilename);
+    }
+    else {
+        globals.allSettings->getString(DataLinkGroup, "Capture File", captureFilename);
+        if (*captureFilename != '\0') {
+            CaptureHeader header;
+            memset(&header, 0, sizeof(header));
+            header.simVarsSize = sizeof(SimVars);
+            header.dataSize = dataSize;
+            memcpy(header.fields, request.fields, sizeof(header.fields));
+            captureFile.openWrite(captureFilename, &header);
+            capturing = true;
+            printf("Capturing to %s\n", captureFilename);
+        }
+    }
+
+    // Data link thread handles signals (see dataLink). Block them here
+    // so all threads started from now on inherit the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
     // Start data link thread
     dataLinkThread = new std::thread(dataLink, this);
 }
@@ -40,193 +417,2524 @@ simvars::~simvars()
         // Wait for thread to exit
         dataLinkThread->join();
     }
+
+    closesocket(sockfd);
+    close(activityfd);
+
+    stats.dump();
 }
 
 /// <summary>
-/// Write event to Flight Sim with optional data value
+/// Returns a positive setting from the Data Link group or the default
 /// </summary>
-void simvars::write(EVENT_ID eventId, double value)
+int simvars::rateSetting(const char* name, int defaultVal)
 {
-    if (!globals.dataLinked) {
+    int val = globals.allSettings->getInt(DataLinkGroup, name);
+    if (val <= 0) {
+        return defaultVal;
+    }
+
+    return val;
+}
+
+/// <summary>
+/// Called when the panel has any input (GPIO or events written) so the
+/// data link can boost its poll rate and get the sim's echo quickly.
+/// Safe to call from any thread and cheap to call very frequently.
+/// </summary>
+void simvars::activity()
+{
+    long long nowNs = monotonicNs();
+    long long lastNs = lastActivityNs;
+
+    // Data link only needs waking once per holdoff period
+    if (nowNs - lastNs < ActivityHoldoffNs || !lastActivityNs.compare_exchange_strong(lastNs, nowNs)) {
         return;
     }
 
-    writeRequest.requestedSize = sizeof(WriteData);
-    writeRequest.writeData.eventId = eventId;
-    writeRequest.writeData.value = value;
+    uint64_t one = 1;
+    if (::write(activityfd, &one, sizeof(one)) != sizeof(one)) {
+        // Data link will pick up the new rate on its next poll anyway
+    }
+}
 
-    if (writeSockfd == INVALID_SOCKET) {
-        if ((writeSockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET) {
-            printf("Failed to create UDP socket for writing\n");
-            fflush(stdout);
-            return;
-        }
+/// <summary>
+/// Poll rate the data link should currently be using
+/// </summary>
+long simvars::pollRate()
+{
+    long long nowNs = monotonicNs();
+    long long sinceActivityNs = nowNs - lastActivityNs;
 
-        int opt = 1;
-        setsockopt(writeSockfd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+    if (sinceActivityNs < boostNs || suspectSinceNs != 0) {
+        return boostRate;
+    }
 
-        writeAddr.sin_family = AF_INET;
-        writeAddr.sin_port = htons(dataLinkPort);
-        inet_pton(AF_INET, dataLinkHost, &writeAddr.sin_addr);
+    if (!globals.connected) {
+        return disconnectedRate;
     }
 
-    int bytes = sendto(writeSockfd, (char*)&writeRequest, sizeof(writeRequest), 0, (SOCKADDR*)&writeAddr, sizeof(writeAddr));
-    if (bytes <= 0) {
-        printf("Failed to write event %d\n", eventId);
-        fflush(stdout);
+    if (sinceActivityNs < idleNs) {
+        return globals.dataRateFps;
     }
+
+    return idleRate;
 }
 
 /// <summary>
-/// Re-initialise everything when connection lost
+/// Called once per frame by the main loop. Picks up the most recently
+/// published SimVars (if any) and returns true if they are new. The
+/// snapshot stays consistent until the next call.
 /// </summary>
-void resetConnection(simvars* thisPtr)
+bool simvars::snapshot()
 {
-    // Only want a subset of SimVars for Radio panel (to save bandwidth)
-    dataSize = (int)((long)(&thisPtr->simVars.transponderCode) + sizeof(double) - (long)&thisPtr->simVars);
-    request.requestedSize = dataSize;
+    if ((middle.load(std::memory_order_relaxed) & NewFrameBit) == 0) {
+        memset(dirty, 0, sizeof(dirty));
+        return false;
+    }
 
-    // Want full data on first connect
-    request.wantFullData = 1;
-    nextFull = globals.dataRateFps * 13;
+    unsigned int prevGeneration = frameGeneration;
+    frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & ~NewFrameBit;
+    simVars = &buffers[frontIndex];
+    frameGeneration = bufferGeneration[frontIndex];
+    frameSeq = bufferSeq[frontIndex];
 
-    globals.dataLinked = false;
-    globals.connected = false;
-    globals.aircraft = NO_AIRCRAFT;
-    strcpy(globals.lastAircraft, "");
+    memset(dirty, 0, sizeof(dirty));
+    for (int field = 0; field < MaxFields; field++) {
+        if (changedGeneration[frontIndex][field] > prevGeneration) {
+            dirty[field / 32] |= 1u << (field % 32);
+        }
+    }
 
-    printf("Waiting for Data Link at %s:%d\n", dataLinkHost, dataLinkPort);
-    fflush(stdout);
+    return true;
 }
 
 /// <summary>
-/// New data received so perform various checks
+/// Returns true if any field in the range of SimVars offsets changed in
+/// the current snapshot.
+/// </summary>
+bool simvars::changed(int firstOffset, int lastOffset)
+{
+    return fieldsChanged(dirty, firstOffset, lastOffset);
+}
+
+/// <summary>
+/// Buffer the data link thread is free to write the next frame into
+/// </summary>
+SimVars* simvars::backBuffer()
+{
+    return &buffers[backIndex];
+}
+
+/// <summary>
+/// Most recently published frame. The data link thread can still read
+/// this after publishing as it won't be handed back for writing until
+/// a newer frame has been published.
+/// </summary>
+SimVars* simvars::latestBuffer()
+{
+    return &buffers[latestIndex];
+}
+
+/// <summary>
+/// Make the back buffer visible to the main loop. Fields that changed
+/// since the latest frame are stamped with the new generation.
+/// </summary>
+void simvars::publish(int seq, const unsigned int* fieldsChanged)
+{
+    generation++;
+    memcpy(changedGeneration[backIndex], changedGeneration[latestIndex], sizeof(changedGeneration[0]));
+    for (int word = 0; word < FieldWords; word++) {
+        unsigned int bits = fieldsChanged[word];
+        while (bits != 0) {
+            int bit = __builtin_ctz(bits);
+            changedGeneration[backIndex][word * 32 + bit] = generation;
+            bits &= bits - 1;
+        }
+    }
+
+    bufferSeq[backIndex] = seq;
+    bufferGeneration[backIndex] = generation;
+    latestIndex = backIndex;
+    backIndex = middle.exchange(backIndex | NewFrameBit, std::memory_order_acq_rel) & ~NewFrameBit;
+}
+
+/// <summary>
+/// How an event can be combined with other writes of the same event
 /// </summary>
-void processData(simvars* thisPtr)
+WriteKind writeKind(EVENT_ID eventId)
 {
-    globals.connected = (thisPtr->simVars.connected == 1);
+    switch (eventId) {
+    case KEY_ELEV_TRIM_UP:
+    case KEY_ELEV_TRIM_DN:
+    case KEY_FLAPS_INCR:
+    case KEY_FLAPS_DECR:
+    case KEY_AP_ALT_VAR_INC:
+    case KEY_AP_ALT_VAR_DEC:
+    case KEY_AP_VS_VAR_INC:
+    case KEY_AP_VS_VAR_DEC:
+        return WRITE_INCREMENT;
+    case KEY_COM1_STBY_RADIO_SET_HZ:
+    case KEY_COM2_STBY_RADIO_SET_HZ:
+    case KEY_NAV1_STBY_SET_HZ:
+    case KEY_NAV2_STBY_SET_HZ:
+    case KEY_ADF_STBY_SET:
+    case KEY_COM1_RECEIVE_SELECT:
+    case KEY_COM2_RECEIVE_SELECT:
+    case KEY_COM1_VOLUME_SET:
+    case KEY_COM2_VOLUME_SET:
+    case KEY_RADIO_VOR1_IDENT_SET:
+    case KEY_RADIO_VOR2_IDENT_SET:
+    case KEY_RADIO_ADF_IDENT_SET:
+    case KEY_XPNDR_SET:
+    case KEY_XPNDR_STATE:
+    case KEY_SPOILERS_ARM_SET:
+    case KEY_SPOILERS_SET:
+    case KEY_GEAR_SET:
+    case KEY_FLAPS_SET:
+    case KEY_KOHLSMAN_SET:
+    case KEY_HEADING_BUG_SET:
+    case KEY_AP_SPD_VAR_SET:
+    case KEY_AP_MACH_VAR_SET:
+    case KEY_AP_ALT_VAR_SET_ENGLISH:
+    case KEY_AP_VS_VAR_SET_ENGLISH:
+        return WRITE_SET;
+    default:
+        return WRITE_TRIGGER;
+    }
+}
 
+/// <summary>
+/// Queue event to write to Flight Sim with optional data value.
+/// All events queued during a frame are sent together by flush().
+///
+/// Set events overwrite an earlier write of the same event in this
+/// frame and are dropped if the same value is still in flight.
+/// Increment events are combined into a repeat count once the data
+/// link has shown it understands one (see repeatWrites). Nothing is
+/// combined across a trigger event (e.g. a swap) as order matters.
+/// </summary>
+void simvars::write(EVENT_ID eventId, double value)
+{
     if (!globals.dataLinked) {
-        globals.dataLinked = true;
-        printf("Established Data Link at %s:%d\n", dataLinkHost, dataLinkPort);
-        if (!globals.connected) {
-            printf("Waiting for MS FS2020\n");
+        return;
+    }
+
+    WriteKind kind = writeKind(eventId);
+
+    if (kind == WRITE_SET && isInFlight(eventId, value)) {
+        return;
+    }
+
+    if (kind != WRITE_TRIGGER) {
+        for (int i = writeBatch.writeCount - 1; i >= 0; i--) {
+            WriteData* writeData = &writeBatch.writeData[i];
+            if (writeKind(writeData->eventId) == WRITE_TRIGGER) {
+                break;
+            }
+
+            if (writeData->eventId == eventId) {
+                if (kind == WRITE_SET) {
+                    writeData->value = value;
+                    return;
+                }
+                if (writeData->value == value && repeatWrites) {
+                    writeData->repeat++;
+                    return;
+                }
+                break;
+            }
         }
-        fflush(stdout);
     }
 
-    if (globals.connected != prevConnected) {
-        if (globals.connected) {
-            printf("Connected to MS FS2020\n");
+    if (writeBatch.writeCount == MaxWriteBatch) {
+        flush();
+    }
+
+    WriteData* writeData = &writeBatch.writeData[writeBatch.writeCount];
+    writeData->eventId = eventId;
+    writeData->repeat = 1;
+    writeData->value = value;
+    writeBatch.writeCount++;
+}
+
+/// <summary>
+/// Returns true if the same value has been written but the sim
+/// hasn't had a chance to echo it back yet.
+/// </summary>
+bool simvars::isInFlight(EVENT_ID eventId, double value)
+{
+    long long nowNs = monotonicNs();
+
+    for (int i = 0; i < inFlightCount; i++) {
+        if (inFlight[i].eventId == eventId) {
+            return inFlight[i].value == value && frameSeq <= inFlight[i].echoSeq && nowNs < inFlight[i].expiryNs;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Remember a set event that has just been sent
+/// </summary>
+void simvars::addInFlight(EVENT_ID eventId, double value)
+{
+    int slot = 0;
+    while (slot < inFlightCount && inFlight[slot].eventId != eventId) {
+        slot++;
+    }
+
+    if (slot == inFlightCount) {
+        if (inFlightCount == MaxInFlight) {
+            // Replace oldest
+            memmove(&inFlight[0], &inFlight[1], (MaxInFlight - 1) * sizeof(InFlightWrite));
+            slot = MaxInFlight - 1;
         }
         else {
-            printf("Waiting for MS FS2020\n");
+            inFlightCount++;
         }
-        fflush(stdout);
-        prevConnected = globals.connected;
     }
 
-    identifyAircraft(thisPtr->simVars.aircraft);
+    inFlight[slot].eventId = eventId;
+    inFlight[slot].value = value;
+    inFlight[slot].echoSeq = lastSentSeq;
+    inFlight[slot].expiryNs = monotonicNs() + InFlightTimeoutNs;
 }
 
 /// <summary>
-/// A separate thread constantly collects the latest
-/// SimVar values from instrument-data-link.
+/// Send all queued events to Flight Sim in a single datagram.
+/// Called once per frame by the main loop.
 /// </summary>
-void dataLink(simvars* thisPtr)
+void simvars::flush()
 {
-    timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 500000;
-    int actualSize;
-    int bytes;
-    int selFail = 0;
+    if (writeBatch.writeCount == 0) {
+        return;
+    }
 
-    // Create a UDP socket
-    SOCKET sockfd;
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET) {
-        printf("DataLink: Failed to create UDP socket\n");
-        exit(1);
+    writeBatch.requestedSize = sizeof(WriteData);
+    char* batch = (char*)&writeBatch;
+    int batchSize = offsetof(WriteBatch, writeData) + writeBatch.writeCount * sizeof(WriteData);
+
+    ReliableBatch reliableBatch;
+    if (reliableWrites && wantReliable()) {
+        reliableBatch.requestedSize = sizeof(ReliableWrite);
+        reliableBatch.writeCount = writeBatch.writeCount;
+        reliableBatch.session = writeSession;
+
+        int handed = handedOff.load(std::memory_order_relaxed);
+        for (int i = 0; i < writeBatch.writeCount; i++) {
+            writeSeq++;
+            reliableBatch.writes[i].writeSeq = writeSeq;
+            reliableBatch.writes[i].writeData = writeBatch.writeData[i];
+            handoff[(handed + i) & (MaxUnacked - 1)] = reliableBatch.writes[i];
+        }
+        handedOff.store(handed + writeBatch.writeCount, std::memory_order_release);
+
+        batch = (char*)&reliableBatch;
+        batchSize = offsetof(ReliableBatch, writes) + writeBatch.writeCount * sizeof(ReliableWrite);
+        stats.reliableEvents += writeBatch.writeCount;
     }
 
-    int opt = 1;
-    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+    if (capturing) {
+        captureFile.record(monotonicNs(), CAPTURE_WRITTEN, batch, batchSize);
+    }
 
-    sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(dataLinkPort);
-    if (inet_pton(AF_INET, dataLinkHost, &addr.sin_addr) <= 0)
-    {
-        printf("DataLink: Invalid server address: %s\n", dataLinkHost);
-        exit(1);
+    int bytes = batchSize;
+    if (!replaying) {
+        sockaddr_in* addr = &endpoints[activeEndpoint].addr;
+        bytes = sendto(sockfd, batch, batchSize, 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+    }
+    if (bytes <= 0) {
+        printf("Failed to write %d events\n", writeBatch.writeCount);
+        fflush(stdout);
     }
 
-    resetConnection(thisPtr);
+    stats.writeSent(writeBatch.writeCount, batchSize);
 
-    while (!globals.quit) {
-        // Poll instrument data link
-        //if (nextFull > 0) {
-        //    nextFull--;
-        //    request.wantFullData = 0;
-        //} else {
-        //    nextFull = globals.dataRateFps * 2;
-        //    request.wantFullData = 1;
-        //}
-        request.wantFullData = 1;
-        bytes = sendto(sockfd, (char*)&request, sizeof(request), 0, (SOCKADDR*)&addr, sizeof(addr));
-
-        if (bytes > 0) {
-            fd_set fds;
-            FD_ZERO(&fds);
-            FD_SET(sockfd, &fds);
-
-            int sel = select(FD_SETSIZE, &fds, 0, 0, &timeout);
-            if (sel > 0) {
-                selFail = 0;
-                // Receive latest data (delta will never be larger than full data size)
-                bytes = recv(sockfd, deltaData, dataSize, 0);
-
-                if (bytes == sizeof(int)) {
-                    // Data size mismatch
-                    memcpy(&actualSize, &thisPtr->simVars, sizeof(int));
-                    printf("DataLink: Requested %ld bytes but server sent %ld bytes\n", dataSize, actualSize);
-                    fflush(stdout);
-                    exit(1);
-                }
-                else if (bytes > 0) {
-                    if (bytes == dataSize) {
-                        // Full data received
-                        memcpy((char*)&thisPtr->simVars, deltaData, dataSize);
-                    }
-                    else {
-                        // Delta received
-                        receiveDelta(deltaData, bytes, (char*)&thisPtr->simVars);
-                    }
+    // Want to see the result as soon as possible
+    activity();
 
-                    processData(thisPtr);
-                }
-                else {
-                    bytes = SOCKET_ERROR;
-                }
-            }
-            else {
-                // Link can blip so wait for multiple failures
-                selFail++;
-                if (selFail > 15) {
-                    bytes = SOCKET_ERROR;
-                }
+    // Remember what is now in flight. A trigger event can change what
+    // a set event does (e.g. set standby then swap) so forget the lot.
+    for (int i = 0; i < writeBatch.writeCount; i++) {
+        WriteData* writeData = &writeBatch.writeData[i];
+        switch (writeKind(writeData->eventId)) {
+        case WRITE_SET:
+            addInFlight(writeData->eventId, writeData->value);
+            break;
+        case WRITE_TRIGGER:
+            inFlightCount = 0;
+            break;
+        default:
+            break;
+        }
+    }
+
+    writeBatch.writeCount = 0;
+}
+
+/// <summary>
+/// Returns true if the batch holds a trigger event and there is room
+/// to hand it to the data link thread for resending. Sets are safe to
+/// lose as they are repeated until echoed and losing an increment
+/// only loses a single click.
+/// </summary>
+bool simvars::wantReliable()
+{
+    if (handedOff - takenOff + writeBatch.writeCount > MaxUnacked) {
+        return false;
+    }
+
+    for (int i = 0; i < writeBatch.writeCount; i++) {
+        if (writeKind(writeBatch.writeData[i].eventId) == WRITE_TRIGGER) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Work out which fields to request from the ranges of SimVars the
+/// panel uses (all of them if no subscription).
+/// </summary>
+void subscribe(const SimVarRange* subscription)
+{
+    FieldDef fields[MaxFields];
+    int fieldCount = fieldTable(fields);
+
+    memset(wantedFields, 0, sizeof(wantedFields));
+    for (int field = 0; field < fieldCount; field++) {
+        bool wanted = (subscription == NULL);
+        for (const SimVarRange* range = subscription; range && range->first != -1; range++) {
+            if (fields[field].offset >= range->first && fields[field].offset <= range->last) {
+                wanted = true;
+                break;
             }
         }
-        else {
-            bytes = SOCKET_ERROR;
+
+        if (wanted) {
+            wantedFields[field / 32] |= 1u << (field % 32);
+        }
+    }
+
+    request.layoutHash = layoutHash();
+    useFields(wantedFields);
+    hubCodec.subscribe(wantedFields);
+}
+
+/// <summary>
+/// Request the fields in the bitmap. Adjacent fields are merged into
+/// spans so full data unpacks with as few copies as possible.
+/// </summary>
+void useFields(const unsigned int* fieldBits)
+{
+    int fieldCount = fieldTable(fieldDefs);
+    dataSize = 0;
+    spanCount = 0;
+    memcpy(request.fields, fieldBits, sizeof(request.fields));
+    memcpy(activeFields, fieldBits, sizeof(activeFields));
+
+    for (int field = 0; field < fieldCount; field++) {
+        for (int slot = 0; slot < fieldDefs[field].size / 8; slot++) {
+            slotField[fieldDefs[field].offset / 8 + slot] = field;
         }
 
-        if (bytes == SOCKET_ERROR && globals.dataLinked) {
-            resetConnection(thisPtr);
+        if ((fieldBits[field / 32] & (1u << (field % 32))) == 0) {
+            continue;
         }
 
-        usleep(1000000 / globals.dataRateFps);
+        int offset = fieldDefs[field].offset;
+        int size = fieldDefs[field].size;
+        if (spanCount > 0 && spans[spanCount - 1].offset + spans[spanCount - 1].size == offset) {
+            spans[spanCount - 1].size += size;
+        }
+        else {
+            spans[spanCount].offset = offset;
+            spans[spanCount].size = size;
+            spanCount++;
+        }
+        dataSize += size;
     }
 
-    closesocket(sockfd);
+    codec.subscribe(request.fields);
+
+    if (capturing) {
+        captureFile.record(monotonicNs(), CAPTURE_FIELDS, fieldBits, sizeof(request.fields));
+    }
+
+    if (remapped) {
+        // Ask for them by the data link's field numbers
+        memset(request.fields, 0, sizeof(request.fields));
+        for (int field = 0; field < fieldCount; field++) {
+            if (fieldBits[field / 32] & (1u << (field % 32))) {
+                request.fields[wireField[field] / 32] |= 1u << (wireField[field] % 32);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// The data link has a different schema (see SchemaEntry) so work out
+/// which of our fields it has and use just those. A field it has moved
+/// is dropped as full data must be packed in the same order on both
+/// sides. Returns false if the schema is malformed.
+/// </summary>
+bool negotiate(const char* payload, int payloadSize)
+{
+    SchemaEntry theirs[MaxFields];
+    SchemaEntry ours[MaxFields];
+    int theirCount = payloadSize / sizeof(SchemaEntry);
+    int ourCount = schemaEntries(ours);
+
+    if (payloadSize % sizeof(SchemaEntry) != 0 || theirCount >= MaxFields) {
+        return false;
+    }
+    memcpy(theirs, payload, payloadSize);
+
+    for (int field = 0; field < MaxFields; field++) {
+        wireField[field] = -1;
+    }
+    for (int slot = 0; slot < MaxWireSlots; slot++) {
+        localOffset[slot] = -1;
+    }
+
+    // Connected is always field 0
+    wireField[0] = 0;
+    localOffset[0] = 0;
+
+    int wireOffset = sizeof(double);
+    int next = 0;
+    int matched = 0;
+    for (int i = 0; i < theirCount; i++) {
+        int size = theirs[i].size;
+        if (size <= 0 || size % 8 != 0 || wireOffset + size > MaxWireSlots * 8) {
+            return false;
+        }
+
+        for (int j = next; j < ourCount; j++) {
+            if (ours[j].fieldHash == theirs[i].fieldHash && ours[j].size == size) {
+                wireField[j + 1] = i + 1;
+                localOffset[wireOffset / 8] = SimVarSchema[j].offset;
+                next = j + 1;
+                matched++;
+                break;
+            }
+        }
+
+        wireOffset += size;
+    }
+
+    unsigned long long theirHash = layoutHash(theirs, theirCount);
+    remapped = (theirHash != layoutHash());
+    request.layoutHash = theirHash;
+
+    // Compact deltas number fields so only raw frames can be remapped
+    request.encoding = (compactFrames && !remapped) ? ENCODING_COMPACT : ENCODING_RAW;
+
+    unsigned int fieldBits[FieldWords];
+    for (int word = 0; word < FieldWords; word++) {
+        fieldBits[word] = 0;
+        for (int bit = 0; bit < 32; bit++) {
+            if ((wantedFields[word] & (1u << bit)) && wireField[word * 32 + bit] != -1) {
+                fieldBits[word] |= 1u << bit;
+            }
+        }
+    }
+    useFields(fieldBits);
+    request.requestedSize = dataSize;
+
+    if (remapped) {
+        printf("DataLink: Data link has a different schema, using %d of its %d fields\n", matched, theirCount);
+        fflush(stdout);
+    }
+    return true;
+}
+
+/// <summary>
+/// Copy the wanted fields the data link doesn't have from one SimVars
+/// to another
+/// </summary>
+void copyMissing(char* dest, const char* src)
+{
+    int fieldCount = fieldTable(fieldDefs);
+
+    for (int field = 0; field < fieldCount; field++) {
+        unsigned int bit = 1u << (field % 32);
+        if ((wantedFields[field / 32] & bit) && !(activeFields[field / 32] & bit)) {
+            int offset = fieldDefs[field].offset;
+            memcpy(dest + offset, src + offset, fieldDefs[field].size);
+        }
+    }
+}
+
+/// <summary>
+/// Move the records of a raw delta from the data link's offsets to
+/// ours. Returns false if a record is for a field we don't have.
+/// </summary>
+bool remapDelta(char* delta, int deltaSize)
+{
+    const int StringFlag = 0x10000;
+    int pos = 0;
+
+    while (deltaSize - pos >= (int)sizeof(DeltaDouble)) {
+        int offset;
+        memcpy(&offset, delta + pos, sizeof(int));
+        bool isString = (offset & StringFlag) != 0;
+        unsigned int wireOffset = offset & ~StringFlag;
+
+        if (wireOffset >= MaxWireSlots * 8 || (wireOffset & 7) != 0 || localOffset[wireOffset / 8] == -1) {
+            return false;
+        }
+
+        offset = localOffset[wireOffset / 8] | (isString ? StringFlag : 0);
+        memcpy(delta + pos, &offset, sizeof(int));
+        pos += isString ? sizeof(DeltaString) : sizeof(DeltaDouble);
+    }
+
+    // Anything left over is rejected by decodeRawDelta
+    return true;
+}
+
+/// <summary>
+/// Unpack full data (subscribed fields packed in order) into SimVars
+/// </summary>
+void unpackFields(char* simVarsPtr, const char* packed)
+{
+    for (int i = 0; i < spanCount; i++) {
+        memcpy(simVarsPtr + spans[i].offset, packed, spans[i].size);
+        packed += spans[i].size;
+    }
+}
+
+/// <summary>
+/// Pack up to size bytes of subscribed fields. Reverses a receive
+/// that was scattered straight into SimVars.
+/// </summary>
+void packFields(char* packed, const char* simVarsPtr, int size)
+{
+    for (int i = 0; i < spanCount && size > 0; i++) {
+        int spanSize = (spans[i].size < size) ? spans[i].size : size;
+        memcpy(packed, simVarsPtr + spans[i].offset, spanSize);
+        packed += spanSize;
+        size -= spanSize;
+    }
+}
+
+/// <summary>
+/// Scatter up to size bytes of packed fields into SimVars in the
+/// same way recvmmsg does.
+/// </summary>
+void scatterFields(char* simVarsPtr, const char* packed, int size)
+{
+    for (int i = 0; i < spanCount && size > 0; i++) {
+        int spanSize = (spans[i].size < size) ? spans[i].size : size;
+        memcpy(simVarsPtr + spans[i].offset, packed, spanSize);
+        packed += spanSize;
+        size -= spanSize;
+    }
+}
+
+/// <summary>
+/// Copy subscribed fields from one SimVars to another
+/// </summary>
+void copyFields(char* dest, const char* src)
+{
+    for (int i = 0; i < spanCount; i++) {
+        memcpy(dest + spans[i].offset, src + spans[i].offset, spans[i].size);
+    }
+}
+
+/// <summary>
+/// Work out which subscribed fields differ between the frame being
+/// published and the latest one. Spans are diffed a slot at a time
+/// (see diffSlots) and changed slots are only mapped to fields if
+/// something actually changed, which most of the time it hasn't.
+/// </summary>
+void markChanges(const char* simVarsPtr, const char* prevVarsPtr)
+{
+    unsigned int slotBits[SlotWords];
+    bool changed = false;
+
+    memset(frameDirty, 0, sizeof(frameDirty));
+
+    if (allDirty) {
+        memset(slotBits, 0xff, sizeof(slotBits));
+        changed = true;
+        allDirty = false;
+    }
+    else {
+        memset(slotBits, 0, sizeof(slotBits));
+        for (int i = 0; i < spanCount; i++) {
+            if (diffSlots(slotBits, simVarsPtr, prevVarsPtr, spans[i].offset, spans[i].size)) {
+                changed = true;
+            }
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    for (int i = 0; i < spanCount; i++) {
+        for (int slot = spans[i].offset / 8; slot < (spans[i].offset + spans[i].size) / 8; slot++) {
+            if (slotBits[slot / 32] & (1u << (slot % 32))) {
+                int field = slotField[slot];
+                frameDirty[field / 32] |= 1u << (field % 32);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Returns true if any field in the range of SimVars offsets is
+/// set in the dirty bitmap.
+/// </summary>
+bool fieldsChanged(const unsigned int* dirty, int firstOffset, int lastOffset)
+{
+    for (int slot = firstOffset / 8; slot <= lastOffset / 8; slot++) {
+        int field = slotField[slot];
+        if (dirty[field / 32] & (1u << (field % 32))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Add an endpoint for a host (or host:port). Returns false if the
+/// address is invalid.
+/// </summary>
+bool addEndpoint(char* host)
+{
+    int port = dataLinkPort;
+    char* portPtr = strchr(host, ':');
+    if (portPtr) {
+        *portPtr = '\0';
+        port = atoi(portPtr + 1);
+    }
+
+    Endpoint* endpoint = &endpoints[endpointCount];
+    memset(endpoint, 0, sizeof(Endpoint));
+    snprintf(endpoint->name, sizeof(endpoint->name), "%s:%d", host, port);
+    endpoint->addr.sin_family = AF_INET;
+    endpoint->addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &endpoint->addr.sin_addr) <= 0 || port <= 0 || port > 65535) {
+        return false;
+    }
+
+    endpointCount++;
+    return true;
+}
+
+/// <summary>
+/// Add an endpoint for every comma separated host (or host:port).
+/// A host of auto (or no hosts) starts discovery straight away.
+/// </summary>
+void addEndpoints(const char* hosts)
+{
+    char hostList[256];
+    char* savePtr;
+
+    strcpy(hostList, hosts);
+    for (char* host = strtok_r(hostList, ", ", &savePtr); host; host = strtok_r(NULL, ", ", &savePtr)) {
+        if (strcmp(host, "auto") == 0) {
+            discoverRounds = 0;
+            continue;
+        }
+
+        if (endpointCount == MaxEndpoints) {
+            printf("DataLink: Too many hosts (max %d)\n", MaxEndpoints);
+            exit(1);
+        }
+
+        if (!addEndpoint(host)) {
+            printf("DataLink: Invalid server address: %s\n", host);
+            exit(1);
+        }
+    }
+
+    if (endpointCount == 0) {
+        discoverRounds = 0;
+    }
+}
+
+/// <summary>
+/// Add the data link we used last time (if we know it) so it is asked
+/// straight away without waiting for discovery.
+/// </summary>
+void loadCachedEndpoint()
+{
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%s", globals.SettingsDir, CacheFile);
+
+    FILE* inf = fopen(filename, "r");
+    if (!inf) {
+        return;
+    }
+
+    if (fgets(cachedEndpoint, sizeof(cachedEndpoint), inf)) {
+        cachedEndpoint[strcspn(cachedEndpoint, "\r\n")] = '\0';
+    }
+    fclose(inf);
+
+    char host[64];
+    strcpy(host, cachedEndpoint);
+    if (*host == '\0' || endpointCount == MaxEndpoints || !addEndpoint(host)) {
+        return;
+    }
+
+    // Already listed in Host
+    for (int endpoint = 0; endpoint < endpointCount - 1; endpoint++) {
+        if (sameEndpoint(&endpoints[endpoint].addr, &endpoints[endpointCount - 1].addr)) {
+            endpointCount--;
+            break;
+        }
+    }
+}
+
+/// <summary>
+/// Remember the data link in use for next time
+/// </summary>
+void rememberEndpoint()
+{
+    // Hub subscribers and attached panels don't talk to a data link
+    if (hubMode == HUB_SUBSCRIBE || sharedMode == SHARED_ATTACH || strcmp(cachedEndpoint, endpoints[activeEndpoint].name) == 0) {
+        return;
+    }
+
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%s", globals.SettingsDir, CacheFile);
+
+    FILE* outf = fopen(filename, "w");
+    if (!outf) {
+        printf("DataLink: Failed to write %s\n", filename);
+        fflush(stdout);
+        return;
+    }
+
+    fprintf(outf, "%s\n", endpoints[activeEndpoint].name);
+    fclose(outf);
+    strcpy(cachedEndpoint, endpoints[activeEndpoint].name);
+}
+
+/// <summary>
+/// Find this machine's addresses and the broadcast address of every
+/// local network. Networks may come up after we start (e.g. WiFi) so
+/// this is done again for every discovery.
+/// </summary>
+void scanInterfaces()
+{
+    ifaddrs* interfaces;
+    if (getifaddrs(&interfaces) != 0) {
+        return;
+    }
+
+    localCount = 0;
+    broadcastCount = 0;
+    for (ifaddrs* ifa = interfaces; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET) {
+            continue;
+        }
+
+        if (localCount < MaxInterfaces) {
+            localAddrs[localCount++] = ((sockaddr_in*)ifa->ifa_addr)->sin_addr;
+        }
+        if ((ifa->ifa_flags & IFF_BROADCAST) && ifa->ifa_broadaddr && broadcastCount < MaxInterfaces) {
+            broadcastAddrs[broadcastCount++] = ((sockaddr_in*)ifa->ifa_broadaddr)->sin_addr;
+        }
+    }
+
+    freeifaddrs(interfaces);
+}
+
+/// <summary>
+/// Returns true if addr is on this machine
+/// </summary>
+bool isLocal(sockaddr_in* addr)
+{
+    if ((ntohl(addr->sin_addr.s_addr) >> 24) == 127) {
+        return true;
+    }
+
+    for (int i = 0; i < localCount; i++) {
+        if (localAddrs[i].s_addr == addr->sin_addr.s_addr) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Returns true if both addresses reach the same data link. A data
+/// link on this machine answers on every one of its addresses.
+/// </summary>
+bool sameEndpoint(sockaddr_in* addr1, sockaddr_in* addr2)
+{
+    if (addr1->sin_port != addr2->sin_port) {
+        return false;
+    }
+
+    return addr1->sin_addr.s_addr == addr2->sin_addr.s_addr || (isLocal(addr1) && isLocal(addr2));
+}
+
+/// <summary>
+/// Probe for data links on every local network that has a broadcast
+/// address and on this machine. Any data link answers a probe so
+/// nothing is needed on its side. Answers from data links we don't
+/// know yet are added (see discovered).
+/// </summary>
+void sendDiscovery(long long nowNs)
+{
+    Request probe = request;
+    probe.baseline = 0;
+    probe.wantFullData = 1;
+    discoverSeq = probe.seq;
+    discoverNs = nowNs;
+    discoveryOpen = true;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(dataLinkPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(sockfd, (char*)&probe, sizeof(probe), 0, (SOCKADDR*)&addr, sizeof(addr));
+
+    scanInterfaces();
+    for (int i = 0; i < broadcastCount; i++) {
+        addr.sin_addr = broadcastAddrs[i];
+        sendto(sockfd, (char*)&probe, sizeof(probe), 0, (SOCKADDR*)&addr, sizeof(addr));
+    }
+}
+
+/// <summary>
+/// Returns true if a datagram is an answer to the latest discovery
+/// </summary>
+bool discoveryAnswer(FrameHeader* header)
+{
+    if (!discoveryOpen || globals.dataLinked || header->seq != discoverSeq) {
+        return false;
+    }
+
+    return header->encoding == ENCODING_RAW || header->encoding == ENCODING_COMPACT || header->encoding == ENCODING_SCHEMA;
+}
+
+/// <summary>
+/// A data link we didn't know about answered discovery. Returns its
+/// new endpoint or -1 if there is no room for it or it is one we
+/// already have under another address.
+/// </summary>
+int discovered(sockaddr_in* addr)
+{
+    if (endpointCount == MaxEndpoints) {
+        return -1;
+    }
+
+    for (int endpoint = 0; endpoint < endpointCount; endpoint++) {
+        if (sameEndpoint(&endpoints[endpoint].addr, addr)) {
+            return -1;
+        }
+    }
+
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, host, sizeof(host));
+
+    Endpoint* endpoint = &endpoints[endpointCount];
+    memset(endpoint, 0, sizeof(Endpoint));
+    snprintf(endpoint->name, sizeof(endpoint->name), "%s:%d", host, ntohs(addr->sin_port));
+    endpoint->addr = *addr;
+    endpoint->probeNs = discoverNs;
+
+    printf("DataLink: Found %s\n", endpoint->name);
+    fflush(stdout);
+
+    // Choose between everything that answers (see probeAnswered)
+    if (!globals.dataLinked) {
+        probing = true;
+    }
+
+    return endpointCount++;
+}
+
+/// <summary>
+/// Returns the endpoint a datagram came from or -1 if unknown
+/// </summary>
+int endpointOf(sockaddr_in* addr)
+{
+    for (int endpoint = 0; endpoint < endpointCount; endpoint++) {
+        if (endpoints[endpoint].addr.sin_addr.s_addr == addr->sin_addr.s_addr && endpoints[endpoint].addr.sin_port == addr->sin_port) {
+            return endpoint;
+        }
+    }
+
+    return -1;
+}
+
+/// <summary>
+/// Send a request for full data to every endpoint except the active
+/// one (unless it is included) to find out which are alive.
+/// </summary>
+void sendProbes(bool includeActive, long long nowNs)
+{
+    Request probe = request;
+    probe.baseline = 0;
+    probe.wantFullData = 1;
+
+    for (int endpoint = 0; endpoint < endpointCount; endpoint++) {
+        if (endpoint != activeEndpoint || includeActive) {
+            endpoints[endpoint].probeNs = nowNs;
+            endpoints[endpoint].answered = false;
+            sendto(sockfd, (char*)&probe, sizeof(probe), 0, (SOCKADDR*)&endpoints[endpoint].addr, sizeof(sockaddr_in));
+        }
+    }
+}
+
+/// <summary>
+/// Full data from a probe says if that endpoint's sim is connected
+/// (assume it is if connected isn't subscribed).
+/// </summary>
+bool probeConnected(FrameHeader* header, const char* payload, int payloadSize)
+{
+    if ((request.fields[0] & 1) == 0) {
+        return true;
+    }
+
+    if (header->baseline != 0 || payloadSize < (int)sizeof(double)) {
+        return false;
+    }
+
+    if (header->encoding == ENCODING_COMPACT) {
+        // Connected is the first bit
+        return (payload[0] & 1) != 0;
+    }
+
+    double connected;
+    memcpy(&connected, payload, sizeof(double));
+    return connected == 1;
+}
+
+/// <summary>
+/// Send the data request, as a StreamRequest for frames at rate when
+/// streaming. Returns the bytes sent or SOCKET_ERROR.
+/// </summary>
+int sendRequest(sockaddr_in* addr, long rate)
+{
+    if (!streaming) {
+        return sendto(sockfd, (char*)&request, sizeof(request), 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+    }
+
+    StreamRequest streamRequest;
+    streamRequest.request = request;
+    streamRequest.rate = rate;
+    streamRequest.resync = streamResync ? 1 : 0;
+    streamResync = false;
+    return sendto(sockfd, (char*)&streamRequest, sizeof(streamRequest), 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+}
+
+/// <summary>
+/// Ask a server to stop pushing frames
+/// </summary>
+void stopStream(sockaddr_in* addr)
+{
+    StreamRequest streamRequest;
+    streamRequest.request = request;
+    streamRequest.rate = 0;
+    streamRequest.resync = 0;
+    sendto(sockfd, (char*)&streamRequest, sizeof(streamRequest), 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+}
+
+/// <summary>
+/// While streaming, a request is only needed as a keepalive, to change
+/// the rate, to catch up after missing a frame or to get full data
+/// again (or see if a suspect link is still there).
+/// </summary>
+bool keepaliveDue(long long nowNs, long rate)
+{
+    if (!globals.dataLinked || rate != streamRate) {
+        return true;
+    }
+
+    if (wantFull || streamResync || suspectSinceNs != 0) {
+        return nowNs - keepaliveNs >= StreamResyncNs;
+    }
+
+    return nowNs - keepaliveNs >= StreamKeepaliveNs;
+}
+
+/// <summary>
+/// Switch to another endpoint without going through a full reset
+/// </summary>
+void failover(int endpoint)
+{
+    printf("DataLink: Failing over from %s to %s\n", endpoints[activeEndpoint].name, endpoints[endpoint].name);
+    fflush(stdout);
+
+    if (streaming) {
+        stopStream(&endpoints[activeEndpoint].addr);
+        keepaliveNs = 0;
+    }
+
+    activeEndpoint = endpoint;
+    appliedSeq = 0;
+    wantFull = true;
+    allDirty = true;
+    suspectSinceNs = 0;
+    rememberEndpoint();
+}
+
+/// <summary>
+/// Record a probe response. While probing, the endpoint is chosen once
+/// every endpoint has answered or SelectWindowNs after the first one
+/// did. Otherwise fail over straight away if the active endpoint is
+/// suspect or its sim isn't connected and this one's is.
+/// </summary>
+void probeAnswered(int endpoint, FrameHeader* header, const char* payload, int payloadSize, long long nowNs)
+{
+    if (endpoint == -1 || endpoints[endpoint].answered) {
+        return;
+    }
+
+    endpoints[endpoint].answered = true;
+    endpoints[endpoint].rttNs = nowNs - endpoints[endpoint].probeNs;
+    endpoints[endpoint].connected = probeConnected(header, payload, payloadSize);
+
+    if (probing) {
+        bool allAnswered = true;
+        for (int i = 0; i < endpointCount; i++) {
+            allAnswered &= endpoints[i].answered;
+        }
+
+        if (allAnswered) {
+            selectByNs = nowNs;
+        }
+        else if (selectByNs == 0) {
+            selectByNs = nowNs + SelectWindowNs;
+        }
+    }
+    else if (endpoints[endpoint].connected && globals.dataLinked && (suspectSinceNs != 0 || !globals.connected)) {
+        failover(endpoint);
+    }
+}
+
+/// <summary>
+/// Choose the endpoint to use from the probe responses. A connected
+/// sim wins, then the lowest RTT, but the current endpoint is kept
+/// unless another one is clearly better. Returns false if nothing
+/// has answered yet.
+/// </summary>
+bool selectEndpoint(long long nowNs)
+{
+    int best = -1;
+    for (int endpoint = 0; endpoint < endpointCount; endpoint++) {
+        Endpoint* candidate = &endpoints[endpoint];
+        if (!candidate->answered) {
+            continue;
+        }
+
+        if (best == -1 || (candidate->connected && !endpoints[best].connected) ||
+            (candidate->connected == endpoints[best].connected && candidate->rttNs < endpoints[best].rttNs))
+        {
+            best = endpoint;
+        }
+    }
+
+    if (best == -1) {
+        return false;
+    }
+
+    Endpoint* current = &endpoints[activeEndpoint];
+    if (current->answered && current->connected == endpoints[best].connected &&
+        current->rttNs <= endpoints[best].rttNs * StickyRttMultiple + StickyRttNs)
+    {
+        best = activeEndpoint;
+    }
+
+    if (best != activeEndpoint) {
+        printf("DataLink: Using %s (RTT %.1fms)\n", endpoints[best].name, endpoints[best].rttNs / 1000000.0);
+        fflush(stdout);
+        activeEndpoint = best;
+    }
+
+    probing = false;
+    selectByNs = 0;
+    chosenNs = nowNs;
+    return true;
+}
+
+/// <summary>
+/// Set up the multicast group for the hub. The publisher sends from
+/// its own socket so subscribers know where to send events. Each
+/// subscriber listens on the group port with the data link socket.
+/// </summary>
+void openHub()
+{
+    char group[64] = "239.255.52.20";
+    globals.allSettings->getString(DataLinkGroup, "Hub Group", group);
+    int port = globals.allSettings->getInt(DataLinkGroup, "Hub Port");
+    if (port == INT_MIN) {
+        port = 52030;
+    }
+
+    memset(&hubGroupAddr, 0, sizeof(hubGroupAddr));
+    hubGroupAddr.sin_family = AF_INET;
+    hubGroupAddr.sin_port = htons(port);
+    if (inet_pton(AF_INET, group, &hubGroupAddr.sin_addr) <= 0) {
+        printf("DataLink: Invalid hub group: %s\n", group);
+        exit(1);
+    }
+
+    if (hubMode == HUB_PUBLISH) {
+        if ((hubfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) == INVALID_SOCKET) {
+            printf("DataLink: Failed to create hub socket\n");
+            exit(1);
+        }
+
+        unsigned char ttl = 1;
+        setsockopt(hubfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        printf("Publishing to hub %s:%d\n", group, port);
+        return;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    // Other subscribers may be on this machine too
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(sockfd, (SOCKADDR*)&addr, sizeof(addr)) != 0) {
+        printf("DataLink: Failed to bind to hub port %d\n", port);
+        exit(1);
+    }
+
+    ip_mreq membership;
+    membership.imr_multiaddr = hubGroupAddr.sin_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+        printf("DataLink: Failed to join hub group %s\n", group);
+        exit(1);
+    }
+
+    // Events go to the publisher (see hubLayout)
+    endpointCount = 1;
+    discovering = false;
+    snprintf(endpoints[0].name, sizeof(endpoints[0].name), "hub %.47s:%d", group, port);
+}
+
+/// <summary>
+/// Pack every wanted field, whether or not the data link has it.
+/// Returns the packed size.
+/// </summary>
+int packHubFields(char* packed, const char* simVarsPtr)
+{
+    int fieldCount = fieldTable(fieldDefs);
+    int size = 0;
+
+    for (int field = 0; field < fieldCount; field++) {
+        if (wantedFields[field / 32] & (1u << (field % 32))) {
+            memcpy(packed + size, simVarsPtr + fieldDefs[field].offset, fieldDefs[field].size);
+            size += fieldDefs[field].size;
+        }
+    }
+
+    return size;
+}
+
+/// <summary>
+/// Multicast the frame just published. Only sends a delta if anything
+/// changed but always sends a keyframe (full data) every KeyframeNs so
+/// new or lossy subscribers can sync and know the hub is alive.
+/// </summary>
+void hubPublish(simvars* thisPtr, bool changed, long long nowNs)
+{
+    FrameHeader* header = (FrameHeader*)hubFrame;
+    char* payload = hubFrame + sizeof(FrameHeader);
+    int size = -1;
+
+    bool keyframe = (hubSeq == 0 || nowNs - lastKeyframeNs >= KeyframeNs);
+    if (!keyframe && !changed) {
+        return;
+    }
+
+    const char* latest = (char*)thisPtr->latestBuffer();
+
+    if (keyframe) {
+        char layout[sizeof(FrameHeader) + sizeof(HubLayout)];
+        int layoutBytes = hubLayoutMessage(layout);
+        sendto(hubfd, layout, layoutBytes, 0, (SOCKADDR*)&hubGroupAddr, sizeof(hubGroupAddr));
+    }
+
+    header->seq = hubSeq + 1;
+    header->encoding = ENCODING_COMPACT;
+    if (!keyframe) {
+        header->baseline = hubSeq;
+        size = hubCodec.encodeDelta(payload, latest, (char*)&hubPrev);
+    }
+    if (size == -1) {
+        header->baseline = 0;
+        size = hubCodec.encode(payload, latest, 0);
+        lastKeyframeNs = nowNs;
+    }
+    if (size == -1) {
+        // Not compactable so send raw
+        header->encoding = ENCODING_RAW;
+        size = packHubFields(payload, latest);
+    }
+
+    hubSeq++;
+    memcpy(&hubPrev, latest, sizeof(SimVars));
+
+    int bytes = sizeof(FrameHeader) + size;
+    if (sendto(hubfd, hubFrame, bytes, 0, (SOCKADDR*)&hubGroupAddr, sizeof(hubGroupAddr)) == bytes) {
+        thisPtr->stats.hubFrames++;
+        thisPtr->stats.hubBytes += bytes;
+    }
+}
+
+/// <summary>
+/// Build the message that tells the other end of the hub our layout.
+/// Returns its size.
+/// </summary>
+int hubLayoutMessage(char* data)
+{
+    FrameHeader header;
+    header.seq = 0;
+    header.baseline = 0;
+    header.encoding = ENCODING_LAYOUT;
+
+    HubLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.simVarsSize = sizeof(SimVars);
+    layout.layoutHash = layoutHash();
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), &layout, sizeof(layout));
+    return sizeof(header) + sizeof(layout);
+}
+
+/// <summary>
+/// Returns true if the other end of the hub has the same layout as us
+/// </summary>
+bool sameLayout(const char* payload, int payloadSize)
+{
+    HubLayout layout;
+    if (payloadSize != sizeof(layout)) {
+        return false;
+    }
+
+    memcpy(&layout, payload, sizeof(layout));
+    return layout.simVarsSize == sizeof(SimVars) && layout.layoutHash == layoutHash();
+}
+
+/// <summary>
+/// A subscriber with the same layout answered a keyframe so its
+/// events can be relayed until it stops answering. Replaces the
+/// subscriber heard from least recently if the table is full.
+/// </summary>
+void hubJoined(sockaddr_in* addr, long long nowNs)
+{
+    int oldest = 0;
+    for (int i = 0; i < hubSubscriberCount; i++) {
+        if (hubSubscribers[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr && hubSubscribers[i].addr.sin_port == addr->sin_port) {
+            hubSubscribers[i].lastNs = nowNs;
+            return;
+        }
+        if (hubSubscribers[i].lastNs < hubSubscribers[oldest].lastNs) {
+            oldest = i;
+        }
+    }
+
+    int slot = (hubSubscriberCount < MaxHubSubscribers) ? hubSubscriberCount++ : oldest;
+    hubSubscribers[slot].addr = *addr;
+    hubSubscribers[slot].lastNs = nowNs;
+
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, host, sizeof(host));
+    printf("DataLink: Hub subscriber %s:%d\n", host, ntohs(addr->sin_port));
+    fflush(stdout);
+}
+
+/// <summary>
+/// Returns true if addr is a subscriber that is still answering
+/// </summary>
+bool hubSubscribed(sockaddr_in* addr, long long nowNs)
+{
+    for (int i = 0; i < hubSubscriberCount; i++) {
+        if (hubSubscribers[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr && hubSubscribers[i].addr.sin_port == addr->sin_port) {
+            return nowNs - hubSubscribers[i].lastNs <= HubTimeoutNs;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Forward events written by subscribers to the data link. Anything
+/// that isn't from a known subscriber is dropped.
+/// </summary>
+void hubRelay(simvars* thisPtr)
+{
+    char data[8192];
+    sockaddr_in addr;
+    socklen_t addrSize = sizeof(addr);
+    long long nowNs = monotonicNs();
+    int bytes;
+
+    while ((bytes = recvfrom(hubfd, data, sizeof(data), 0, (SOCKADDR*)&addr, &addrSize)) > 0) {
+        addrSize = sizeof(addr);
+
+        if (bytes == (int)(sizeof(FrameHeader) + sizeof(HubLayout)) && ((FrameHeader*)data)->encoding == ENCODING_LAYOUT) {
+            if (sameLayout(data + sizeof(FrameHeader), bytes - sizeof(FrameHeader))) {
+                hubJoined(&addr, nowNs);
+            }
+            continue;
+        }
+
+        if (bytes < (int)(offsetof(WriteBatch, writeData) + sizeof(WriteData)) || ((WriteBatch*)data)->requestedSize != sizeof(WriteData)) {
+            continue;
+        }
+
+        if (!hubSubscribed(&addr, nowNs)) {
+            continue;
+        }
+
+        sockaddr_in* linkAddr = &endpoints[activeEndpoint].addr;
+        if (globals.dataLinked && sendto(sockfd, data, bytes, 0, (SOCKADDR*)linkAddr, sizeof(sockaddr_in)) == bytes) {
+            thisPtr->stats.relayedWrites += ((WriteBatch*)data)->writeCount;
+        }
+
+        // Want to see the result quickly
+        thisPtr->activity();
+    }
+}
+
+/// <summary>
+/// Send events somewhere else. The new address goes in the spare
+/// endpoint so flush() never sees it half written. Returns false if
+/// events already go there.
+/// </summary>
+bool followAddress(sockaddr_in* addr)
+{
+    Endpoint* active = &endpoints[activeEndpoint];
+    if (active->addr.sin_addr.s_addr == addr->sin_addr.s_addr && active->addr.sin_port == addr->sin_port) {
+        return false;
+    }
+
+    int spare = 1 - activeEndpoint;
+    endpoints[spare] = *active;
+    endpoints[spare].addr = *addr;
+    activeEndpoint = spare;
+    return true;
+}
+
+/// <summary>
+/// Returns true if a subscriber has a publisher and addr is it
+/// </summary>
+bool fromPublisher(sockaddr_in* addr)
+{
+    if (!hubLayoutOk) {
+        return false;
+    }
+
+    sockaddr_in* publisher = &endpoints[activeEndpoint].addr;
+    return replaying || (publisher->sin_addr.s_addr == addr->sin_addr.s_addr && publisher->sin_port == addr->sin_port);
+}
+
+/// <summary>
+/// A publisher sent its layout. A subscriber only takes frames from
+/// (and sends events to) a publisher whose layout matches its own, so
+/// nothing else on the hub port can take it over. If the publisher
+/// changes it has restarted so start again from its next keyframe.
+/// Answers with our layout so the publisher relays our events.
+/// </summary>
+void hubLayout(sockaddr_in* addr, const char* payload, int payloadSize)
+{
+    if (!sameLayout(payload, payloadSize)) {
+        if (fromPublisher(addr)) {
+            hubLayoutOk = false;
+        }
+        if (!hubLayoutWarned) {
+            printf("DataLink: Hub publisher was built with different SimVars so ignoring it\n");
+            fflush(stdout);
+            hubLayoutWarned = true;
+        }
+        return;
+    }
+
+    hubLayoutOk = true;
+    hubLayoutWarned = false;
+    if (replaying) {
+        return;
+    }
+
+    if (followAddress(addr)) {
+        appliedSeq = 0;
+
+        char host[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, host, sizeof(host));
+        printf("DataLink: Hub publisher is %s:%d\n", host, ntohs(addr->sin_port));
+        fflush(stdout);
+    }
+
+    char layout[sizeof(FrameHeader) + sizeof(HubLayout)];
+    int layoutBytes = hubLayoutMessage(layout);
+    sendto(sockfd, layout, layoutBytes, 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+}
+
+/// <summary>
+/// Re-initialise everything when connection lost
+/// </summary>
+void resetConnection(simvars* thisPtr)
+{
+    request.requestedSize = dataSize;
+    request.encoding = (compactFrames && !remapped) ? ENCODING_COMPACT : ENCODING_RAW;
+
+    // Want full data on first connect
+    request.wantFullData = 1;
+    appliedSeq = 0;
+    wantFull = true;
+    allDirty = true;
+    suspectSinceNs = 0;
+    reconnectNs = MinReconnectNs;
+    streamRate = 0;
+    streamResync = false;
+    keepaliveNs = 0;
+    sizeWarned = false;
+    unansweredRounds = 0;
+
+    // Too late for anything not yet acknowledged. Next data link may
+    // not understand repeats.
+    unackedCount = 0;
+    repeatWrites = false;
+    takenOff = handedOff.load();
+
+    globals.dataLinked = false;
+    globals.connected = false;
+    globals.aircraft = NO_AIRCRAFT;
+    strcpy(globals.lastAircraft, "");
+
+    if (sharedMode == SHARED_PUBLISH) {
+        sharedVars.write(thisPtr->latestBuffer(), false, &endpoints[activeEndpoint].addr);
+    }
+
+    if (endpointCount == 0) {
+        printf("Looking for Data Link on the local network\n");
+    }
+    else {
+        printf("Waiting for Data Link at %s", endpoints[0].name);
+        for (int endpoint = 1; endpoint < endpointCount; endpoint++) {
+            printf(", %s", endpoints[endpoint].name);
+        }
+        printf(discovering ? " or on the local network\n" : "\n");
+    }
+    fflush(stdout);
+}
+
+/// <summary>
+/// New data received so perform various checks
+/// </summary>
+void processData(SimVars* simVars)
+{
+    globals.connected = (simVars->connected == 1);
+
+    if (!globals.dataLinked) {
+        globals.dataLinked = true;
+        printf("Established Data Link at %s\n", endpoints[activeEndpoint].name);
+        rememberEndpoint();
+
+        // Anything discovered meanwhile is only a standby now
+        probing = false;
+        selectByNs = 0;
+        discoveryOpen = false;
+        if (!globals.connected) {
+            printf("Waiting for MS FS2020\n");
+        }
+        fflush(stdout);
+    }
+
+    if (globals.connected != prevConnected) {
+        if (globals.connected) {
+            printf("Connected to MS FS2020\n");
+        }
+        else {
+            printf("Waiting for MS FS2020\n");
+        }
+        fflush(stdout);
+        prevConnected = globals.connected;
+    }
+
+    if (fieldsChanged(frameDirty, offsetof(SimVars, aircraft), offsetof(SimVars, aircraft))) {
+        identifyAircraft(simVars->aircraft);
+    }
+}
+
+/// <summary>
+/// Apply a single frame to the back buffer. Returns false if the frame
+/// is stale or cannot be applied. The back buffer only needs bringing
+/// up to date from the latest frame (synced) before the first delta.
+/// </summary>
+bool applyFrame(simvars* thisPtr, FrameHeader* header, char* payload, int payloadSize, bool* synced)
+{
+    char* back = (char*)thisPtr->backBuffer();
+
+    if (appliedSeq != 0 && header->seq <= appliedSeq) {
+        // Duplicate or arrived out of order
+        return false;
+    }
+
+    if (header->baseline == 0 && header->encoding == ENCODING_COMPACT) {
+        // Compact full data received
+        if (!codec.decode(back, payload, payloadSize, (char*)thisPtr->latestBuffer())) {
+            wantFull = true;
+            return false;
+        }
+        *synced = true;
+    }
+    else if (header->baseline == 0) {
+        if (payloadSize != dataSize) {
+            wantFull = true;
+            return false;
+        }
+
+        // Full data received
+        if (payload != back) {
+            unpackFields(back, payload);
+        }
+        *synced = true;
+    }
+    else if (header->baseline == appliedSeq) {
+        // Delta received
+        if (!*synced) {
+            copyFields(back, (char*)thisPtr->latestBuffer());
+            *synced = true;
+        }
+        if (header->encoding == ENCODING_COMPACT) {
+            if (!codec.decodeDelta(back, payload, payloadSize)) {
+                wantFull = true;
+                return false;
+            }
+        }
+        else if ((remapped && !remapDelta(payload, payloadSize)) || !codec.decodeRawDelta(back, payload, payloadSize)) {
+            wantFull = true;
+            return false;
+        }
+    }
+    else if (header->baseline < appliedSeq) {
+        // Delta was requested before we applied a newer frame
+        return false;
+    }
+    else if (streaming) {
+        // Missed a pushed frame so catch up from where we are
+        streamResync = true;
+        return false;
+    }
+    else {
+        // Delta is against a frame we never applied
+        wantFull = true;
+        return false;
+    }
+
+    appliedSeq = header->seq;
+    wantFull = false;
+    return true;
+}
+
+/// <summary>
+/// Handle a batch of datagrams received from instrument-data-link.
+/// The latest full frame wins and anything older is discarded, then
+/// any deltas that follow it are applied in sequence order (skipping
+/// any that are superseded by a later delta). Slot 0
+/// is scattered straight into the back buffer so the usual case of a
+/// single full frame needs no copying.
+/// </summary>
+bool receiveBatch(simvars* thisPtr, mmsghdr* msgs, int count)
+{
+    char* back = (char*)thisPtr->backBuffer();
+    long long nowNs = monotonicNs();
+    int order[BatchSize];
+    int valid = 0;
+
+    for (int i = 0; i < count; i++) {
+        int bytes = msgs[i].msg_len;
+
+        if (capturing) {
+            int headerSize = (bytes < (int)sizeof(FrameHeader)) ? bytes : sizeof(FrameHeader);
+            char* payload = batchData[i];
+            if (i == 0) {
+                payload = captureData;
+                packFields(payload, back, bytes - headerSize);
+                if (bytes - headerSize > dataSize) {
+                    memcpy(payload + dataSize, batchData[0] + dataSize, bytes - headerSize - dataSize);
+                }
+            }
+            captureFile.record(nowNs, CAPTURE_RECEIVED, &batchHeaders[i], headerSize, payload, bytes - headerSize);
+        }
+
+        if (hubMode == HUB_SUBSCRIBE) {
+            if (bytes >= (int)sizeof(FrameHeader) && batchHeaders[i].encoding == ENCODING_LAYOUT) {
+                char* payload = batchData[i];
+                if (i == 0) {
+                    packFields(payload, back, bytes - sizeof(FrameHeader));
+                }
+                hubLayout(&batchAddrs[i], payload, bytes - sizeof(FrameHeader));
+                continue;
+            }
+
+            // Nothing else on the hub port is any use
+            if (bytes < (int)sizeof(FrameHeader) || !fromPublisher(&batchAddrs[i])) {
+                continue;
+            }
+        }
+
+        if (bytes == sizeof(int)) {
+            // Data size mismatch. No layout hashes to 0 so the next
+            // request gets the data link's schema and we use the
+            // fields we both have (see negotiate).
+            int actualSize;
+            memcpy(&actualSize, &batchHeaders[i], sizeof(int));
+            if (reliableWrites && actualSize == request.requestedSize) {
+                // Our request was the right size so it was a reliable
+                // batch that got rejected (see resendWrites).
+                if (!reliableWarned) {
+                    printf("DataLink: Data link doesn't support reliable writes, sending events normally\n");
+                    fflush(stdout);
+                    reliableWarned = true;
+                }
+                reliableWrites = false;
+                continue;
+            }
+            if (!sizeWarned) {
+                printf("DataLink: Requested %d bytes but data link sends %d bytes, asking for its schema\n", dataSize, actualSize);
+                fflush(stdout);
+                sizeWarned = true;
+            }
+            request.layoutHash = 0;
+            wantFull = true;
+            continue;
+        }
+
+        if (bytes < (int)sizeof(FrameHeader)) {
+            continue;
+        }
+
+        if (batchHeaders[i].encoding == ENCODING_ACK) {
+            // Reliable writes acknowledged (see resendWrites)
+            if (batchHeaders[i].seq == writeSession) {
+                if (batchHeaders[i].baseline > ackedWriteSeq) {
+                    ackedWriteSeq = batchHeaders[i].baseline;
+                }
+                repeatWrites = true;
+            }
+            continue;
+        }
+
+        if ((endpointCount > 1 || discovering) && !replaying) {
+            int endpoint = endpointOf(&batchAddrs[i]);
+            if (endpoint == -1 && discovering && discoveryAnswer(&batchHeaders[i])) {
+                endpoint = discovered(&batchAddrs[i]);
+            }
+            if (probing || endpoint != activeEndpoint) {
+                char* payload = batchData[i];
+                if (i == 0) {
+                    packFields(payload, back, bytes - sizeof(FrameHeader));
+                }
+                // A schema answers the probe but says nothing about the sim
+                int payloadSize = (batchHeaders[i].encoding == ENCODING_SCHEMA) ? 0 : bytes - sizeof(FrameHeader);
+                probeAnswered(endpoint, &batchHeaders[i], payload, payloadSize, nowNs);
+                continue;
+            }
+        }
+
+        if (batchHeaders[i].encoding == ENCODING_SCHEMA) {
+            // Data link was built with a different schema
+            char* payload = batchData[i];
+            if (i == 0) {
+                packFields(payload, back, bytes - sizeof(FrameHeader));
+            }
+            if (negotiate(payload, bytes - sizeof(FrameHeader))) {
+                // The schema may have been scattered over fields we no longer get
+                copyMissing(back, (char*)thisPtr->latestBuffer());
+                request.wantFullData = 1;
+                wantFull = true;
+                allDirty = true;
+            }
+            continue;
+        }
+
+        int seq = batchHeaders[i].seq;
+        if (seq > lastAnsweredSeq) {
+            lastAnsweredSeq = seq;
+        }
+        thisPtr->stats.responseReceived(seq, nowNs);
+        thisPtr->stats.frameReceived(batchHeaders[i].baseline == 0, bytes);
+
+        // Keep frames in sequence order in case any were reordered
+        int pos = valid;
+        while (pos > 0 && batchHeaders[order[pos - 1]].seq > seq) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = i;
+        valid++;
+    }
+
+    // Latest full frame wins
+    int first = 0;
+    for (int pos = valid - 1; pos > 0; pos--) {
+        if (batchHeaders[order[pos]].baseline == 0) {
+            first = pos;
+            break;
+        }
+    }
+    thisPtr->stats.stale += first;
+
+    // Move slot 0 out of the back buffer unless it is the raw full
+    // frame we are starting from (or stale, in which case it is not needed).
+    char* payload0 = back;
+    for (int pos = first; pos < valid; pos++) {
+        if (order[pos] == 0) {
+            if (pos != first || batchHeaders[0].baseline != 0 || batchHeaders[0].encoding != ENCODING_RAW) {
+                payload0 = batchData[0];
+                packFields(payload0, back, msgs[0].msg_len - sizeof(FrameHeader));
+            }
+            break;
+        }
+    }
+
+    bool synced = false;
+    bool updated = false;
+    for (int pos = first; pos < valid; pos++) {
+        int i = order[pos];
+        char* payload = (i == 0) ? payload0 : batchData[i];
+        int payloadSize = msgs[i].msg_len - sizeof(FrameHeader);
+
+        // Deltas against the same baseline are cumulative so a later
+        // one supersedes this one.
+        bool superseded = false;
+        for (int later = pos + 1; later < valid; later++) {
+            if (batchHeaders[order[later]].baseline == batchHeaders[i].baseline) {
+                superseded = true;
+                break;
+            }
+        }
+
+        if (superseded) {
+            thisPtr->stats.stale++;
+            continue;
+        }
+
+        if (applyFrame(thisPtr, &batchHeaders[i], payload, payloadSize, &synced)) {
+            updated = true;
+        }
+        else {
+            thisPtr->stats.stale++;
+        }
+    }
+
+    if (updated) {
+        markChanges((char*)thisPtr->backBuffer(), (char*)thisPtr->latestBuffer());
+        if (fieldsChanged(frameDirty, offsetof(SimVars, sbEncoder), offsetof(SimVars, sbParkBrake))) {
+            // SwitchBox input
+            thisPtr->activity();
+        }
+        processData(thisPtr->backBuffer());
+        thisPtr->publish(appliedSeq, frameDirty);
+
+        if (sharedMode == SHARED_PUBLISH) {
+            sharedVars.write(thisPtr->latestBuffer(), true, &endpoints[activeEndpoint].addr);
+            thisPtr->stats.sharedFrames++;
+        }
+    }
+
+    if (updated && hubMode == HUB_PUBLISH) {
+        bool changed = false;
+        for (int word = 0; word < FieldWords; word++) {
+            changed |= (frameDirty[word] != 0);
+        }
+        hubPublish(thisPtr, changed, nowNs);
+    }
+
+    return valid > 0;
+}
+
+/// <summary>
+/// Returns the current monotonic time in nanoseconds
+/// </summary>
+long long monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/// <summary>
+/// Returns how long the oldest request still waiting for an answer
+/// has been waiting (later answers cover earlier requests).
+/// </summary>
+long long unansweredNs(simvars* thisPtr, long long nowNs)
+{
+    long long oldestNs = 0;
+
+    int sentSeq = lastSentSeq;
+    for (int seq = sentSeq; seq > lastAnsweredSeq && seq > sentSeq - SentHistory; seq--) {
+        // Stream requests skip seqs
+        if (thisPtr->stats.sentSeq[seq & (SentHistory - 1)] == seq) {
+            oldestNs = nowNs - thisPtr->stats.sentNs[seq & (SentHistory - 1)];
+        }
+    }
+
+    return oldestNs;
+}
+
+/// <summary>
+/// Check the link is still alive. It becomes suspect if a request has
+/// gone unanswered for SuspectRttMultiple times the RTT p99, in which
+/// case full data is wanted and pollRate boosts to probe it. It is lost
+/// if there is still no response after LostRttMultiple times the RTT
+/// p99 (both have a minimum so a quick LAN doesn't reset on a blip).
+/// Returns true if the link has been lost.
+/// </summary>
+bool linkLost(simvars* thisPtr, long long nowNs, long long lastResponseNs)
+{
+    double rttNs = DefaultRttNs;
+    if (thisPtr->stats.rttCount >= MinRttSamples) {
+        rttNs = thisPtr->stats.rttPercentileMs(99) * 1000000.0;
+    }
+
+    if (suspectSinceNs == 0) {
+        long long suspectNs = SuspectRttMultiple * rttNs;
+        if (suspectNs < MinSuspectNs) {
+            suspectNs = MinSuspectNs;
+        }
+
+        if (unansweredNs(thisPtr, nowNs) > suspectNs) {
+            suspectSinceNs = nowNs;
+            wantFull = true;
+            thisPtr->stats.suspects++;
+        }
+        return false;
+    }
+
+    long long lostNs = LostRttMultiple * rttNs;
+    if (lostNs < MinLostNs) {
+        lostNs = MinLostNs;
+    }
+
+    long long silenceNs = nowNs - lastResponseNs;
+    if (silenceNs <= lostNs) {
+        return false;
+    }
+
+    thisPtr->stats.linkLost(silenceNs);
+    lostAtNs = nowNs;
+    printf("DataLink: Lost after %.0fms without a response (RTT p99 %.1fms)\n", silenceNs / 1000000.0, rttNs / 1000000.0);
+    fflush(stdout);
+    return true;
+}
+
+/// <summary>
+/// A response has arrived so the link is no longer suspect. Reports
+/// how long it took to recover if it had been lost.
+/// </summary>
+void linkResponded(simvars* thisPtr, long long nowNs)
+{
+    suspectSinceNs = 0;
+
+    if (lostAtNs != 0 && globals.dataLinked) {
+        thisPtr->stats.linkRecovered(nowNs - lostAtNs);
+        printf("DataLink: Recovered after %.1f secs\n", (nowNs - lostAtNs) / 1000000000.0);
+        fflush(stdout);
+        lostAtNs = 0;
+    }
+}
+
+/// <summary>
+/// Delay before the next attempt to reach a data link that isn't
+/// answering. Doubles each time up to MaxReconnectNs and is jittered
+/// so panels don't all hit a restarted server at the same moment.
+/// </summary>
+long long reconnectDelayNs()
+{
+    long long delayNs = reconnectNs / 2 + random() % (reconnectNs / 2 + 1);
+
+    reconnectNs *= 2;
+    if (reconnectNs > MaxReconnectNs) {
+        reconnectNs = MaxReconnectNs;
+    }
+
+    return delayNs;
+}
+
+/// <summary>
+/// Arm the poll timer so it fires on absolute deadlines at the
+/// required rate. Deadlines don't drift with round trip time.
+/// </summary>
+void setPollRate(int timerfd, long fps)
+{
+    long long intervalNs = 1000000000LL / fps;
+    long long firstNs = monotonicNs() + intervalNs;
+
+    itimerspec spec;
+    spec.it_interval.tv_sec = intervalNs / 1000000000LL;
+    spec.it_interval.tv_nsec = intervalNs % 1000000000LL;
+    spec.it_value.tv_sec = firstNs / 1000000000LL;
+    spec.it_value.tv_nsec = firstNs % 1000000000LL;
+
+    if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+        printf("DataLink: Failed to set poll timer\n");
+        exit(1);
+    }
+}
+
+/// <summary>
+/// Arm the poll timer to fire once after a delay
+/// </summary>
+void setPollDelay(int timerfd, long long delayNs)
+{
+    itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = delayNs / 1000000000LL;
+    spec.it_value.tv_nsec = delayNs % 1000000000LL;
+
+    if (timerfd_settime(timerfd, 0, &spec, NULL) != 0) {
+        printf("DataLink: Failed to set poll timer\n");
+        exit(1);
+    }
+}
+
+/// <summary>
+/// Handle a pending signal (if any)
+/// </summary>
+void handleSignal(simvars* thisPtr, int signalfd)
+{
+    signalfd_siginfo info;
+    if (read(signalfd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGUSR1) {
+            thisPtr->stats.dump();
+        }
+        else {
+            globals.quit = true;
+        }
+    }
+}
+
+/// <summary>
+/// Feed a capture through the same path as received data, at the
+/// recorded speed multiplied by replaySpeed or as fast as possible if
+/// replaySpeed is 0. Datagrams received together (same timestamp) are
+/// replayed as one batch and fields are changed where they changed
+/// when captured. Quits when the capture ends.
+/// </summary>
+void replay(simvars* thisPtr, int signalfd)
+{
+    mmsghdr msgs[BatchSize];
+    CaptureRecord* recs[BatchSize];
+    char* recData[BatchSize];
+    long long startNs = monotonicNs();
+    long long firstNs = -1;
+    int frames = 0;
+    int writes = 0;
+
+    resetConnection(thisPtr);
+
+    char* data;
+    CaptureRecord* rec = captureFile.next(&data);
+    while (!globals.quit && rec) {
+        if (rec->type == CAPTURE_FIELDS && rec->size == sizeof(request.fields)) {
+            unsigned int fieldBits[FieldWords];
+            memcpy(fieldBits, data, sizeof(fieldBits));
+            useFields(fieldBits);
+            rec = captureFile.next(&data);
+            continue;
+        }
+        if (rec->type != CAPTURE_RECEIVED) {
+            writes++;
+            rec = captureFile.next(&data);
+            continue;
+        }
+
+        int count = 0;
+        long long batchNs = rec->timeNs;
+        while (rec && count < BatchSize && rec->type == CAPTURE_RECEIVED && rec->timeNs == batchNs) {
+            recs[count] = rec;
+            recData[count] = data;
+            count++;
+            rec = captureFile.next(&data);
+        }
+
+        if (firstNs == -1) {
+            firstNs = batchNs;
+        }
+        if (replaySpeed > 0) {
+            long long dueNs = startNs + (batchNs - firstNs) / replaySpeed;
+            timespec due;
+            due.tv_sec = dueNs / 1000000000LL;
+            due.tv_nsec = dueNs % 1000000000LL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+        }
+
+        // Received as if by recvmmsg (see dataLink)
+        char* back = (char*)thisPtr->backBuffer();
+        for (int slot = 0; slot < count; slot++) {
+            int bytes = recs[slot]->size;
+            if (bytes > (int)(sizeof(FrameHeader) + sizeof(batchData[slot]))) {
+                bytes = sizeof(FrameHeader) + sizeof(batchData[slot]);
+            }
+            int headerSize = (bytes < (int)sizeof(FrameHeader)) ? bytes : sizeof(FrameHeader);
+            memcpy(&batchHeaders[slot], recData[slot], headerSize);
+            if (slot == 0) {
+                scatterFields(back, recData[slot] + headerSize, bytes - headerSize);
+                if (bytes - headerSize > dataSize) {
+                    memcpy(batchData[0] + dataSize, recData[slot] + headerSize + dataSize, bytes - headerSize - dataSize);
+                }
+            }
+            else {
+                memcpy(batchData[slot], recData[slot] + headerSize, bytes - headerSize);
+            }
+            msgs[slot].msg_len = bytes;
+        }
+
+        receiveBatch(thisPtr, msgs, count);
+        frames += count;
+        handleSignal(thisPtr, signalfd);
+    }
+
+    double secs = (monotonicNs() - startNs) / 1000000000.0;
+    printf("Replayed %d datagrams (%d writes) in %.3f secs, %.0f datagrams/sec\n", frames, writes, secs, frames / secs);
+    fflush(stdout);
+    globals.quit = true;
+}
+
+/// <summary>
+/// How long to wait for a reliable write to be acknowledged
+/// </summary>
+long long resendDelayNs(simvars* thisPtr)
+{
+    double rttNs = DefaultRttNs;
+    if (thisPtr->stats.rttCount >= MinRttSamples) {
+        rttNs = thisPtr->stats.rttPercentileMs(99) * 1000000.0;
+    }
+
+    long long delayNs = (long long)(ResendRttMultiple * rttNs) << resends;
+    if (delayNs < MinResendNs) {
+        return MinResendNs;
+    }
+    if (delayNs > MaxResendNs) {
+        return MaxResendNs;
+    }
+
+    return delayNs;
+}
+
+/// <summary>
+/// Pick up reliable writes sent by the main loop, forget any that have
+/// been acknowledged and resend the rest (oldest first) if they are
+/// overdue. Gives up after MaxResends.
+/// </summary>
+void resendWrites(simvars* thisPtr, long long nowNs)
+{
+    int handed = handedOff.load(std::memory_order_acquire);
+    int taken = takenOff.load(std::memory_order_relaxed);
+    while (taken != handed && unackedCount < MaxUnacked) {
+        if (unackedCount == 0) {
+            resends = 0;
+            resendNs = nowNs + resendDelayNs(thisPtr);
+        }
+        unacked[unackedCount++] = handoff[taken & (MaxUnacked - 1)];
+        taken++;
+    }
+    takenOff.store(taken, std::memory_order_release);
+
+    int kept = 0;
+    for (int i = 0; i < unackedCount; i++) {
+        if (unacked[i].writeSeq > ackedWriteSeq) {
+            unacked[kept++] = unacked[i];
+        }
+    }
+    unackedCount = kept;
+
+    if (!reliableWrites) {
+        // The data link rejected them so send them once, normally
+        sendUnreliable(thisPtr, nowNs);
+        return;
+    }
+
+    if (unackedCount == 0 || nowNs < resendNs) {
+        return;
+    }
+
+    if (resends == MaxResends) {
+        printf("DataLink: Gave up writing %d events\n", unackedCount);
+        fflush(stdout);
+        thisPtr->stats.abandonedEvents += unackedCount;
+        unackedCount = 0;
+        return;
+    }
+
+    ReliableBatch batch;
+    batch.requestedSize = sizeof(ReliableWrite);
+    batch.session = writeSession;
+    sockaddr_in* addr = &endpoints[activeEndpoint].addr;
+    for (int first = 0; first < unackedCount; first += MaxWriteBatch) {
+        batch.writeCount = unackedCount - first;
+        if (batch.writeCount > MaxWriteBatch) {
+            batch.writeCount = MaxWriteBatch;
+        }
+        memcpy(batch.writes, &unacked[first], batch.writeCount * sizeof(ReliableWrite));
+
+        int batchSize = offsetof(ReliableBatch, writes) + batch.writeCount * sizeof(ReliableWrite);
+        if (capturing) {
+            captureFile.record(nowNs, CAPTURE_WRITTEN, &batch, batchSize);
+        }
+        sendto(sockfd, (char*)&batch, batchSize, 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+    }
+
+    thisPtr->stats.resentEvents += unackedCount;
+    resends++;
+    resendNs = nowNs + resendDelayNs(thisPtr);
+}
+
+/// <summary>
+/// Send events waiting to be acknowledged as ordinary writes
+/// </summary>
+void sendUnreliable(simvars* thisPtr, long long nowNs)
+{
+    WriteBatch batch;
+    batch.requestedSize = sizeof(WriteData);
+    sockaddr_in* addr = &endpoints[activeEndpoint].addr;
+    for (int first = 0; first < unackedCount; first += MaxWriteBatch) {
+        batch.writeCount = unackedCount - first;
+        if (batch.writeCount > MaxWriteBatch) {
+            batch.writeCount = MaxWriteBatch;
+        }
+        for (int i = 0; i < batch.writeCount; i++) {
+            batch.writeData[i] = unacked[first + i].writeData;
+        }
+
+        int batchSize = offsetof(WriteBatch, writeData) + batch.writeCount * sizeof(WriteData);
+        if (capturing) {
+            captureFile.record(nowNs, CAPTURE_WRITTEN, &batch, batchSize);
+        }
+        sendto(sockfd, (char*)&batch, batchSize, 0, (SOCKADDR*)addr, sizeof(sockaddr_in));
+    }
+
+    thisPtr->stats.resentEvents += unackedCount;
+    unackedCount = 0;
+}
+
+/// <summary>
+/// Copy SimVars out of shared memory whenever the owner publishes
+/// them instead of running a data link. Events still go straight to
+/// the owner's data link.
+/// </summary>
+void attachShared(simvars* thisPtr, int signalfd)
+{
+    unsigned int seenSeq = 0;
+    bool attached = false;
+
+    resetConnection(thisPtr);
+
+    while (!globals.quit) {
+        handleSignal(thisPtr, signalfd);
+
+        if (!attached) {
+            attached = sharedVars.attach(sharedName);
+            if (!attached) {
+                usleep(SharedWaitNs / 1000);
+                continue;
+            }
+        }
+
+        unsigned int seq = sharedVars.wait(seenSeq, SharedWaitNs);
+        if (seq == seenSeq) {
+            if (globals.dataLinked && !sharedVars.ownerAlive()) {
+                printf("DataLink: Shared memory owner has gone\n");
+                resetConnection(thisPtr);
+            }
+            continue;
+        }
+
+        bool linked;
+        sockaddr_in linkAddr;
+        SimVars* back = thisPtr->backBuffer();
+        if (!sharedVars.read(back, &linked, &linkAddr, &seq)) {
+            // Owner is busy writing so try again
+            continue;
+        }
+        seenSeq = seq;
+
+        if (!linked) {
+            if (globals.dataLinked) {
+                resetConnection(thisPtr);
+            }
+            continue;
+        }
+
+        followAddress(&linkAddr);
+        markChanges((char*)back, (char*)thisPtr->latestBuffer());
+        processData(back);
+        thisPtr->publish(seq / 2, frameDirty);
+        thisPtr->stats.sharedFrames++;
+    }
+}
+
+/// <summary>
+/// A separate thread constantly collects the latest
+/// SimVar values from instrument-data-link.
+///
+/// Requests are sent whenever the poll timer fires and
+/// responses are processed as soon as they arrive so the
+/// request rate is not affected by the round trip time.
+/// </summary>
+void dataLink(simvars* thisPtr)
+{
+    int bytes;
+
+    // SIGUSR1 dumps link stats, SIGINT and SIGTERM shut down cleanly
+    // (signals are blocked in all threads by the constructor).
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    int signalfd = ::signalfd(-1, &signals, SFD_NONBLOCK);
+
+    if (replaying) {
+        replay(thisPtr, signalfd);
+        close(signalfd);
+        return;
+    }
+
+    if (sharedMode == SHARED_ATTACH) {
+        attachShared(thisPtr, signalfd);
+        close(signalfd);
+        return;
+    }
+
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timerfd == -1) {
+        printf("DataLink: Failed to create poll timer\n");
+        exit(1);
+    }
+
+    int epollfd = epoll_create1(0);
+    if (epollfd == -1) {
+        printf("DataLink: Failed to create epoll instance\n");
+        exit(1);
+    }
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = sockfd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &event);
+    event.data.fd = timerfd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, timerfd, &event);
+    event.data.fd = thisPtr->activityfd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, thisPtr->activityfd, &event);
+    event.data.fd = signalfd;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, signalfd, &event);
+    if (hubMode == HUB_PUBLISH) {
+        event.data.fd = hubfd;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, hubfd, &event);
+    }
+
+    srandom(monotonicNs());
+    resetConnection(thisPtr);
+    long long lastResponseNs = monotonicNs();
+    long pollRate = thisPtr->pollRate();
+    if (hubMode == HUB_SUBSCRIBE) {
+        // Timer only checks the hub is still publishing
+        setPollRate(timerfd, HubCheckRate);
+    }
+    else {
+        setPollDelay(timerfd, reconnectDelayNs());
+        backingOff = true;
+    }
+
+    mmsghdr msgs[BatchSize];
+    iovec iov[BatchSize][2];
+    iovec backIov[MaxFields + 2];
+    memset(msgs, 0, sizeof(msgs));
+    epoll_event events[4];
+    while (!globals.quit) {
+        int count = epoll_wait(epollfd, events, 4, -1);
+        if (count == -1) {
+            // Interrupted by a signal
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == signalfd) {
+                handleSignal(thisPtr, signalfd);
+            }
+            else if (events[i].data.fd == hubfd) {
+                hubRelay(thisPtr);
+            }
+            else if (events[i].data.fd == thisPtr->activityfd) {
+                // Panel is being used so boost poll rate straight away
+                uint64_t activity;
+                if (read(thisPtr->activityfd, &activity, sizeof(activity)) == sizeof(activity) && !backingOff && pollRate != thisPtr->pollRate()) {
+                    pollRate = thisPtr->pollRate();
+                    setPollRate(timerfd, pollRate);
+                }
+            }
+            else if (events[i].data.fd == timerfd) {
+                // Poll timer fired (may have fired more than once if we
+                // were delayed but we only want one request in that case).
+                uint64_t expirations;
+                if (read(timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                    continue;
+                }
+
+                long long nowNs = monotonicNs();
+                if (hubMode == HUB_SUBSCRIBE) {
+                    if (globals.dataLinked && nowNs - lastResponseNs > HubTimeoutNs) {
+                        printf("DataLink: Nothing from hub for %.1f secs\n", (nowNs - lastResponseNs) / 1000000000.0);
+                        resetConnection(thisPtr);
+                    }
+                    continue;
+                }
+
+                if (probing && selectByNs != 0 && nowNs >= selectByNs) {
+                    selectEndpoint(nowNs);
+                }
+
+                bytes = 0;
+                if (globals.dataLinked && linkLost(thisPtr, nowNs, lastResponseNs)) {
+                    bytes = SOCKET_ERROR;
+                }
+                else if (!streaming || keepaliveDue(nowNs, thisPtr->pollRate())) {
+                    // Poll instrument data link. Server sends a delta against
+                    // the last frame we applied unless we ask for full data,
+                    // which we do if responses have gone missing.
+                    int seq = (lastSentSeq == INT_MAX) ? 1 : lastSentSeq + 1;
+                    if (streaming) {
+                        int sentSeq = lastSentSeq;
+                        seq = ((sentSeq > lastAnsweredSeq) ? sentSeq : lastAnsweredSeq) + StreamSeqGap;
+                        streamRate = thisPtr->pollRate();
+                        keepaliveNs = nowNs;
+                    }
+                    thisPtr->stats.requestSent(seq, nowNs);
+                    lastSentSeq = seq;
+                    request.seq = seq;
+                    request.baseline = appliedSeq;
+                    request.wantFullData = wantFull ? 1 : 0;
+                    request.stringHash = codec.stringHash((char*)thisPtr->latestBuffer());
+
+                    if (discovering && !globals.dataLinked && unansweredRounds++ >= discoverRounds) {
+                        // Look on the local network as well
+                        sendDiscovery(nowNs);
+                    }
+
+                    if (endpointCount > 1 && !globals.dataLinked && (probing || chosenNs == 0)) {
+                        // Find the best endpoint
+                        probing = true;
+                        sendProbes(true, nowNs);
+                    }
+                    else if (endpointCount > 0) {
+                        bytes = sendRequest(&endpoints[activeEndpoint].addr, streamRate);
+                        if (bytes <= 0) {
+                            bytes = SOCKET_ERROR;
+                        }
+
+                        if (endpointCount > 1 && globals.dataLinked && (suspectSinceNs != 0 || !globals.connected)) {
+                            // Look for somewhere better to go
+                            sendProbes(false, nowNs);
+                        }
+
+                        // Probe again next time if chosen endpoint doesn't answer
+                        chosenNs = 0;
+                    }
+                }
+
+                if (bytes == SOCKET_ERROR && globals.dataLinked) {
+                    resetConnection(thisPtr);
+                }
+
+                // Also flushes events handed off just as reliable writes were rejected
+                if (globals.dataLinked) {
+                    resendWrites(thisPtr, nowNs);
+                }
+
+                if (!globals.dataLinked) {
+                    // Keep trying to reach the data link
+                    setPollDelay(timerfd, reconnectDelayNs());
+                    backingOff = true;
+                }
+                else if (pollRate != thisPtr->pollRate()) {
+                    pollRate = thisPtr->pollRate();
+                    setPollRate(timerfd, pollRate);
+                }
+            }
+            else if (events[i].data.fd == sockfd) {
+                // Drain everything that is waiting in one go
+                for (int slot = 1; slot < BatchSize; slot++) {
+                    iov[slot][0].iov_base = &batchHeaders[slot];
+                    iov[slot][0].iov_len = sizeof(FrameHeader);
+                    iov[slot][1].iov_base = batchData[slot];
+                    iov[slot][1].iov_len = sizeof(batchData[slot]);
+                    msgs[slot].msg_hdr.msg_iov = iov[slot];
+                    msgs[slot].msg_hdr.msg_iovlen = 2;
+                }
+
+                for (int slot = 0; slot < BatchSize; slot++) {
+                    msgs[slot].msg_hdr.msg_name = &batchAddrs[slot];
+                    msgs[slot].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                }
+
+                // Slot 0 is unpacked by the kernel
+                char* back = (char*)thisPtr->backBuffer();
+                backIov[0].iov_base = &batchHeaders[0];
+                backIov[0].iov_len = sizeof(FrameHeader);
+                for (int span = 0; span < spanCount; span++) {
+                    backIov[span + 1].iov_base = back + spans[span].offset;
+                    backIov[span + 1].iov_len = spans[span].size;
+                }
+
+                // Anything longer than full data (e.g. a schema) lands
+                // where packFields will leave the start of it.
+                backIov[spanCount + 1].iov_base = batchData[0] + dataSize;
+                backIov[spanCount + 1].iov_len = sizeof(batchData[0]) - dataSize;
+                msgs[0].msg_hdr.msg_iov = backIov;
+                msgs[0].msg_hdr.msg_iovlen = spanCount + 2;
+
+                int received = recvmmsg(sockfd, msgs, BatchSize, MSG_DONTWAIT, NULL);
+                if (received > 0 && receiveBatch(thisPtr, msgs, received)) {
+                    lastResponseNs = monotonicNs();
+                    linkResponded(thisPtr, lastResponseNs);
+
+                    if (backingOff && globals.dataLinked) {
+                        // Back to polling at the normal rate
+                        backingOff = false;
+                        pollRate = thisPtr->pollRate();
+                        setPollRate(timerfd, pollRate);
+                    }
+                }
+
+                if (probing && selectByNs != 0) {
+                    // Choose an endpoint (and ask it for data) as soon
+                    // as the probe responses are in.
+                    long long nowNs = monotonicNs();
+                    setPollDelay(timerfd, (selectByNs > nowNs) ? selectByNs - nowNs : 1);
+                }
+            }
+        }
+    }
+
+    if (streaming && globals.dataLinked) {
+        stopStream(&endpoints[activeEndpoint].addr);
+    }
+
+    close(epollfd);
+    close(signalfd);
+    close(timerfd);
+    if (hubfd != INVALID_SOCKET) {
+        closesocket(hubfd);
+    }
 }
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <thread>
+#include <atomic>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -14,24 +15,98 @@ typedef int SOCKET;
 #define closesocket close
 #include "globals.h"
 #include "simvarDefs.h"
+#include "linkstats.h"
 
 extern globalVars globals;
 
+enum WriteKind {
+    WRITE_TRIGGER,      // Must be sent every time and in order
+    WRITE_SET,          // Sets an absolute value so last write wins
+    WRITE_INCREMENT     // Repeats can be combined into a single write
+};
+
+const int MaxInFlight = 16;
+
+struct InFlightWrite {
+    EVENT_ID eventId;
+    double value;
+    int echoSeq;            // Frames after this one reflect the write
+    long long expiryNs;
+};
+
 class simvars {
 public:
-    SimVars simVars;
+    // Consistent snapshot for the main loop, refreshed by snapshot()
+    SimVars* simVars;
+    unsigned int frameGeneration = 0;
+    int frameSeq = 0;
+
+    // Fields (bit per field number) that changed in the snapshot since
+    // the previous one. Test with changed().
+    unsigned int dirty[FieldWords];
+
+    // Data link performance, dumped on exit or with kill -USR1
+    linkstats stats;
 
 private:
     std::thread* dataLinkThread = NULL;
 
-    SOCKET writeSockfd = INVALID_SOCKET;
-    sockaddr_in writeAddr;
-    Request writeRequest;
+    // Triple buffer shared with the data link thread. The data link
+    // fills the back buffer and swaps it with the middle one to publish
+    // it. The main loop swaps its front buffer with the middle one when
+    // a new frame is waiting so neither side ever has to wait or copy.
+    SimVars buffers[3];
+    std::atomic<int> middle;
+    unsigned int generation = 0;
+    int frontIndex = 0;
+    int backIndex = 2;
+    int latestIndex = 0;
+    int bufferSeq[3] = { 0, 0, 0 };
+
+    // Generation each buffer was published as and the generation each
+    // field last changed in. The main loop can skip generations so this
+    // lets it see every change since the snapshot it last took.
+    unsigned int bufferGeneration[3] = { 0, 0, 0 };
+    unsigned int changedGeneration[3][MaxFields];
+
+    // Events queued during the current frame
+    WriteBatch writeBatch;
+
+    // Adaptive poll rate
+    long boostRate;
+    long idleRate;
+    long disconnectedRate;
+    long long boostNs;
+    long long idleNs;
+    std::atomic<long long> lastActivityNs;
+
+    // Set events sent but not yet seen echoed back by the sim
+    InFlightWrite inFlight[MaxInFlight];
+    int inFlightCount = 0;
 
 public:
-    simvars();
+    simvars(const SimVarRange* subscription = NULL);
     ~simvars();
     void write(EVENT_ID eventId, double value = 0);
+    void flush();
+    void activity();
+    bool snapshot();
+    bool changed(int firstOffset, int lastOffset);
+
+private:
+    bool wantReliable();
+    bool isInFlight(EVENT_ID eventId, double value);
+    void addInFlight(EVENT_ID eventId, double value);
+    int rateSetting(const char* name, int defaultVal);
+
+public:
+
+    // Only called by the data link thread
+    int activityfd;
+    long pollRate();
+    SimVars* backBuffer();
+    SimVars* latestBuffer();
+    void publish(int seq, const unsigned int* fieldsChanged);
 };
 
 #endif // _SIMVARS_H_
@@ -0,0 +1,1336 @@
+/*
+ * Stand-in for instrument-data-link
+ * Copyright (c) 2023 Scott Vincent
+ *
+ * Speaks the same UDP protocol as instrument-data-link so the panel
+ * can be run and tested on any Linux box without MS FS2020. SimVars
+ * are evolved from a script or at random and any events written by
+ * the panel are logged. Latency, loss and reordering can be injected
+ * to see how the data link copes with bad WiFi. Many hub subscribers
+ * can be simulated to load test a panel publishing to a hub.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "simvarDefs.h"
+#include "framecodec.h"
+#include "framediff.h"
+
+extern const char* SimVarDefs[][2];
+extern WriteEvent WriteEvents[];
+
+const int HistorySize = 64;
+const int MaxQueued = 256;
+const int MaxScript = 1024;
+const int MaxFrame = 8192;
+const int MaxSubscribers = 256;
+const int HubPort = 52030;
+const int MaxStreamRate = 100;
+const int MaxStreams = 8;
+const long long StreamIdleNs = 1000000000LL;
+const char* HubGroup = "239.255.52.20";
+
+struct Options {
+    int port = 52020;
+    int latencyMs = 0;
+    int jitterMs = 0;
+    int lossPercent = 0;
+    int reorderPercent = 0;
+    int writeLossPercent = 0;
+    int simRate = 20;
+    bool random = false;
+    bool quiet = false;
+    const char* scriptFile = NULL;
+    int fuzzRuns = 0;
+    int benchRuns = 0;
+    int subscribers = 0;
+};
+
+struct ScriptEntry {
+    double atSecs;
+    int field;
+    char value[32];
+};
+
+struct Queued {
+    long long dueNs;
+    sockaddr_in addr;
+    int size;
+    char data[MaxFrame];
+};
+
+// A simulated panel subscribed to a hub
+struct Subscriber {
+    int fd;
+    sockaddr_in hub;
+    bool haveHub = false;
+    int seq = 0;
+    SimVars vars;
+    long long frames = 0;
+    long long fullFrames = 0;
+    long long deltas = 0;
+    long long gaps = 0;
+    long long errors = 0;
+    long long writes = 0;
+};
+
+// Frames sent and what each contained, so later ones can be deltas
+struct History {
+    SimVars frames[HistorySize];
+    int seqs[HistorySize];
+};
+
+// A panel the stub is pushing frames to. Each stream numbers its own
+// frames so it keeps its own history.
+struct Stream {
+    sockaddr_in addr;
+    long long intervalNs = 0;   // 0 = not streaming
+    long long nextNs = 0;
+    long long pushedNs = 0;
+    long long expiryNs = 0;
+    int seq = 0;
+    bool compact = false;
+    unsigned int stringHash = 0;
+    unsigned int fields[FieldWords];
+    History history;
+};
+
+struct Stats {
+    long long requests = 0;
+    long long fullFrames = 0;
+    long long deltas = 0;
+    long long bytesSent = 0;
+    long long dropped = 0;
+    long long reordered = 0;
+    long long writes = 0;
+    long long pushes = 0;
+    long long writesDropped = 0;
+    long long duplicates = 0;
+    long long schemas = 0;
+};
+
+Options opts;
+Stats stats;
+volatile bool quit = false;
+int sockfd;
+
+// Current state of the sim and what each recent response contained
+SimVars simVars;
+History history;
+
+FieldDef fields[MaxFields];
+int fieldCount;
+unsigned int subscribedFields[FieldWords];
+int packedSize;
+framecodec codec;
+
+Subscriber subscribers[MaxSubscribers];
+framecodec hubCodec;
+
+ScriptEntry script[MaxScript];
+int scriptCount = 0;
+int scriptPos = 0;
+
+Queued queue[MaxQueued];
+int queued = 0;
+Stream streams[MaxStreams];
+
+// Reliable writes applied so far (see receiveReliable)
+int writeSession = 0;
+int lastWriteSeq = 0;
+
+long long monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void usage()
+{
+    printf("Usage: stub-data-link [options]\n");
+    printf("  -p port       UDP port to listen on (default 52020)\n");
+    printf("  -s file       Replay SimVar changes from a script\n");
+    printf("  -x            Make random SimVar changes\n");
+    printf("  -u rate       SimVar updates per second (default 20)\n");
+    printf("  -l ms         Latency added to every response\n");
+    printf("  -j ms         Random jitter added to latency\n");
+    printf("  -d percent    Percentage of responses to drop\n");
+    printf("  -r percent    Percentage of responses to delay past the next one\n");
+    printf("  -w percent    Percentage of event writes to drop\n");
+    printf("  -q            Don't log events written by the panel\n");
+    printf("  -F runs       Fuzz the panel's delta decoders and exit\n");
+    printf("  -B runs       Benchmark the panel's delta decoders and exit\n");
+    printf("  -m count      Simulate panels subscribed to a hub (max %d)\n", MaxSubscribers);
+    printf("\n");
+    printf("Script lines are: <seconds> <SimVar name> = <value>\n");
+    printf("e.g. 2.5 Com Active Frequency:1 = 121.5\n");
+    exit(1);
+}
+
+void onSignal(int)
+{
+    quit = true;
+}
+
+/// <summary>
+/// Returns the field number of a SimVar or -1 if it doesn't exist
+/// </summary>
+int findField(const char* name)
+{
+    if (strcmp(name, "Connected") == 0) {
+        return 0;
+    }
+
+    for (int field = 1; field < fieldCount; field++) {
+        if (strcmp(SimVarDefs[field - 1][0], name) == 0) {
+            return field;
+        }
+    }
+
+    return -1;
+}
+
+void setField(int field, const char* value)
+{
+    char* fieldPtr = (char*)&simVars + fields[field].offset;
+
+    if (fields[field].codec == CODEC_STRING) {
+        strncpy(fieldPtr, value, 32);
+        fieldPtr[31] = '\0';
+    }
+    else {
+        double val = atof(value);
+        memcpy(fieldPtr, &val, sizeof(double));
+    }
+}
+
+void loadScript(const char* filename)
+{
+    FILE* inf = fopen(filename, "r");
+    if (!inf) {
+        printf("Script file %s not found\n", filename);
+        exit(1);
+    }
+
+    char line[256];
+    int lineNum = 0;
+    while (fgets(line, sizeof(line), inf) && scriptCount < MaxScript) {
+        lineNum++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        char* name = strchr(line, ' ');
+        char* value = strstr(line, " = ");
+        if (!name || !value || value < name) {
+            printf("%s:%d: Expected <seconds> <SimVar name> = <value>\n", filename, lineNum);
+            exit(1);
+        }
+        *value = '\0';
+
+        ScriptEntry* entry = &script[scriptCount];
+        entry->atSecs = atof(line);
+        entry->field = findField(name + 1);
+        if (entry->field == -1) {
+            printf("%s:%d: Unknown SimVar: %s\n", filename, lineNum, name + 1);
+            exit(1);
+        }
+        strncpy(entry->value, value + 3, 32);
+        entry->value[31] = '\0';
+        scriptCount++;
+    }
+
+    fclose(inf);
+    printf("Loaded %d script entries from %s\n", scriptCount, filename);
+}
+
+/// <summary>
+/// Apply script entries that are now due
+/// </summary>
+void runScript(double elapsedSecs)
+{
+    while (scriptPos < scriptCount && script[scriptPos].atSecs <= elapsedSecs) {
+        setField(script[scriptPos].field, script[scriptPos].value);
+        scriptPos++;
+    }
+}
+
+/// <summary>
+/// Make a plausible change to a random SimVar
+/// </summary>
+void randomChange()
+{
+    int field = 1 + rand() % (fieldCount - 1);
+    double* valPtr = (double*)((char*)&simVars + fields[field].offset);
+
+    switch (fields[field].codec) {
+    case CODEC_BIT:
+        *valPtr = (*valPtr == 0) ? 1 : 0;
+        break;
+    case CODEC_BYTE:
+        *valPtr = rand() % 4;
+        break;
+    case CODEC_WORD:
+        // Octal digits in BCD like a squawk code
+        *valPtr = ((rand() % 8) << 12) + ((rand() % 8) << 8) + ((rand() % 8) << 4) + rand() % 8;
+        break;
+    case CODEC_MHZ:
+        *valPtr = 118.0 + (rand() % 760) * 0.025;
+        break;
+    case CODEC_KHZ:
+        *valPtr = 190 + rand() % 1560;
+        break;
+    case CODEC_DOUBLE:
+        *valPtr += (rand() % 200 - 100) / 10.0;
+        break;
+    default:
+        break;
+    }
+}
+
+/// <summary>
+/// Make the sim respond to the events that affect the radio panel
+/// so written values are echoed back.
+/// </summary>
+void applyEvent(WriteData* writeData)
+{
+    double temp;
+
+    switch (writeData->eventId) {
+    case KEY_COM1_STBY_RADIO_SET_HZ:
+        simVars.com1Standby = writeData->value / 1000000.0;
+        break;
+    case KEY_COM2_STBY_RADIO_SET_HZ:
+        simVars.com2Standby = writeData->value / 1000000.0;
+        break;
+    case KEY_NAV1_STBY_SET_HZ:
+        simVars.nav1Standby = writeData->value / 1000000.0;
+        break;
+    case KEY_NAV2_STBY_SET_HZ:
+        simVars.nav2Standby = writeData->value / 1000000.0;
+        break;
+    case KEY_COM1_RADIO_SWAP:
+        temp = simVars.com1Freq;
+        simVars.com1Freq = simVars.com1Standby;
+        simVars.com1Standby = temp;
+        break;
+    case KEY_COM2_RADIO_SWAP:
+        temp = simVars.com2Freq;
+        simVars.com2Freq = simVars.com2Standby;
+        simVars.com2Standby = temp;
+        break;
+    case KEY_NAV1_RADIO_SWAP:
+        temp = simVars.nav1Freq;
+        simVars.nav1Freq = simVars.nav1Standby;
+        simVars.nav1Standby = temp;
+        break;
+    case KEY_NAV2_RADIO_SWAP:
+        temp = simVars.nav2Freq;
+        simVars.nav2Freq = simVars.nav2Standby;
+        simVars.nav2Standby = temp;
+        break;
+    case KEY_COM1_RECEIVE_SELECT:
+        simVars.com1Receive = writeData->value;
+        break;
+    case KEY_COM2_RECEIVE_SELECT:
+        simVars.com2Receive = writeData->value;
+        break;
+    case KEY_COM1_TRANSMIT_SELECT:
+        simVars.com1Transmit = 1;
+        simVars.com2Transmit = 0;
+        break;
+    case KEY_COM2_TRANSMIT_SELECT:
+        simVars.com1Transmit = 0;
+        simVars.com2Transmit = 1;
+        break;
+    case KEY_XPNDR_SET:
+        simVars.transponderCode = writeData->value;
+        break;
+    case KEY_XPNDR_STATE:
+        simVars.transponderState = writeData->value;
+        break;
+    default:
+        break;
+    }
+}
+
+/// <summary>
+/// Log an event written by the panel and apply it
+/// </summary>
+void receiveEvent(WriteData* writeData)
+{
+    const char* name = "UNKNOWN";
+    if (writeData->eventId >= 0 && writeData->eventId < SIM_STOP) {
+        name = WriteEvents[writeData->eventId].name;
+    }
+
+    if (!opts.quiet) {
+        printf("Event %s value %g x%d\n", name, writeData->value, writeData->repeat);
+    }
+    for (int repeat = 0; repeat < writeData->repeat || repeat == 0; repeat++) {
+        applyEvent(writeData);
+    }
+    stats.writes++;
+}
+
+/// <summary>
+/// Events are sent as a WriteBatch (or a Request holding one event,
+/// which has the same layout for the first event).
+/// </summary>
+void receiveEvents(char* data, int bytes)
+{
+    WriteBatch* batch = (WriteBatch*)data;
+    int maxCount = (bytes - (int)offsetof(WriteBatch, writeData)) / (int)sizeof(WriteData);
+    int count = batch->writeCount;
+    if (count < 1 || count > maxCount) {
+        count = 1;
+    }
+
+    for (int i = 0; i < count && i < maxCount; i++) {
+        receiveEvent(&batch->writeData[i]);
+    }
+}
+
+/// <summary>
+/// Send a response, possibly late, out of order or not at all
+/// </summary>
+void sendResponse(sockaddr_in* addr, char* data, int size)
+{
+    if (rand() % 100 < opts.lossPercent) {
+        stats.dropped++;
+        return;
+    }
+
+    long long delayNs = opts.latencyMs * 1000000LL;
+    if (opts.jitterMs > 0) {
+        delayNs += (rand() % (opts.jitterMs * 1000)) * 1000LL;
+    }
+    if (rand() % 100 < opts.reorderPercent) {
+        // Hold back long enough for the next response to overtake it
+        delayNs += 2000000000LL / opts.simRate;
+        stats.reordered++;
+    }
+
+    stats.bytesSent += size;
+
+    if (delayNs == 0 || queued == MaxQueued) {
+        sendto(sockfd, data, size, 0, (sockaddr*)addr, sizeof(*addr));
+        return;
+    }
+
+    Queued* entry = &queue[queued++];
+    entry->dueNs = monotonicNs() + delayNs;
+    entry->addr = *addr;
+    entry->size = size;
+    memcpy(entry->data, data, size);
+}
+
+/// <summary>
+/// Send any delayed responses that are now due. Returns ms until the
+/// next one is due (or -1 if none).
+/// </summary>
+int sendQueued()
+{
+    long long nowNs = monotonicNs();
+    long long nextNs = -1;
+
+    for (int i = 0; i < queued; ) {
+        if (queue[i].dueNs <= nowNs) {
+            sendto(sockfd, queue[i].data, queue[i].size, 0, (sockaddr*)&queue[i].addr, sizeof(queue[i].addr));
+            queue[i] = queue[--queued];
+            continue;
+        }
+        if (nextNs == -1 || queue[i].dueNs < nextNs) {
+            nextNs = queue[i].dueNs;
+        }
+        i++;
+    }
+
+    if (nextNs == -1) {
+        return -1;
+    }
+
+    return (int)((nextNs - nowNs + 999999) / 1000000);
+}
+
+/// <summary>
+/// Apply each reliable write once and in order and acknowledge the
+/// last one applied. Anything after a gap is left for the panel to
+/// resend.
+/// </summary>
+void receiveReliable(char* data, int bytes, sockaddr_in* addr)
+{
+    ReliableBatch* batch = (ReliableBatch*)data;
+    int maxCount = (bytes - (int)offsetof(ReliableBatch, writes)) / (int)sizeof(ReliableWrite);
+    int count = (batch->writeCount < maxCount) ? batch->writeCount : maxCount;
+
+    if (batch->session != writeSession) {
+        // Panel restarted
+        writeSession = batch->session;
+        lastWriteSeq = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int seq = batch->writes[i].writeSeq;
+        if (seq <= lastWriteSeq) {
+            stats.duplicates++;
+            continue;
+        }
+        if (seq != lastWriteSeq + 1) {
+            break;
+        }
+        receiveEvent(&batch->writes[i].writeData);
+        lastWriteSeq = seq;
+    }
+
+    FrameHeader ack;
+    ack.seq = writeSession;
+    ack.baseline = lastWriteSeq;
+    ack.encoding = ENCODING_ACK;
+    sendResponse(addr, (char*)&ack, sizeof(ack));
+}
+
+/// <summary>
+/// The panel may change which fields it subscribes to at any time
+/// </summary>
+void subscribe(unsigned int* fieldBits)
+{
+    if (memcmp(fieldBits, subscribedFields, sizeof(subscribedFields)) == 0) {
+        return;
+    }
+
+    memcpy(subscribedFields, fieldBits, sizeof(subscribedFields));
+    codec.subscribe(subscribedFields);
+
+    packedSize = 0;
+    for (int field = 0; field < fieldCount; field++) {
+        if (subscribedFields[field / 32] & (1u << (field % 32))) {
+            packedSize += fields[field].size;
+        }
+    }
+
+    // Anything we sent before is no use as a baseline now
+    memset(history.seqs, 0, sizeof(history.seqs));
+}
+
+int packFull(char* payload)
+{
+    char* pos = payload;
+
+    for (int field = 0; field < fieldCount; field++) {
+        if (subscribedFields[field / 32] & (1u << (field % 32))) {
+            memcpy(pos, (char*)&simVars + fields[field].offset, fields[field].size);
+            pos += fields[field].size;
+        }
+    }
+
+    return pos - payload;
+}
+
+int packDelta(char* payload, SimVars* baseline)
+{
+    char* pos = payload;
+
+    for (int field = 0; field < fieldCount; field++) {
+        if ((subscribedFields[field / 32] & (1u << (field % 32))) == 0) {
+            continue;
+        }
+
+        int offset = fields[field].offset;
+        char* newPtr = (char*)&simVars + offset;
+        if (memcmp(newPtr, (char*)baseline + offset, fields[field].size) == 0) {
+            continue;
+        }
+
+        if (fields[field].codec == CODEC_STRING) {
+            DeltaString* deltaString = (DeltaString*)pos;
+            deltaString->offset = offset | 0x10000;
+            memcpy(deltaString->data, newPtr, 32);
+            pos += sizeof(DeltaString);
+        }
+        else {
+            DeltaDouble* deltaDouble = (DeltaDouble*)pos;
+            deltaDouble->offset = offset;
+            memcpy(&deltaDouble->data, newPtr, sizeof(double));
+            pos += sizeof(DeltaDouble);
+        }
+    }
+
+    return pos - payload;
+}
+
+/// <summary>
+/// Send frame seq as a delta against baseline if we remember it (and
+/// it is worth it) or as full data.
+/// </summary>
+void sendFrame(History* sent, sockaddr_in* addr, int seq, int baseline, bool compact, unsigned int stringHash)
+{
+    char response[MaxFrame];
+    FrameHeader* header = (FrameHeader*)response;
+    char* payload = response + sizeof(FrameHeader);
+
+    header->seq = seq;
+    header->baseline = 0;
+    header->encoding = ENCODING_RAW;
+    int size = -1;
+
+    // Delta if the panel still has a frame we remember
+    int slot = baseline & (HistorySize - 1);
+    if (baseline != 0 && sent->seqs[slot] == baseline) {
+        if (compact) {
+            size = codec.encodeDelta(payload, (char*)&simVars, (char*)&sent->frames[slot]);
+            header->encoding = ENCODING_COMPACT;
+        }
+        if (size == -1) {
+            size = packDelta(payload, &sent->frames[slot]);
+            header->encoding = ENCODING_RAW;
+        }
+        if (size >= packedSize) {
+            size = -1;
+        }
+        else {
+            header->baseline = baseline;
+        }
+    }
+
+    if (header->baseline == 0) {
+        size = -1;
+        if (compact) {
+            size = codec.encode(payload, (char*)&simVars, stringHash);
+            header->encoding = ENCODING_COMPACT;
+        }
+        if (size == -1) {
+            size = packFull(payload);
+            header->encoding = ENCODING_RAW;
+        }
+        stats.fullFrames++;
+    }
+    else {
+        stats.deltas++;
+    }
+
+    slot = seq & (HistorySize - 1);
+    sent->frames[slot] = simVars;
+    sent->seqs[slot] = seq;
+
+    sendResponse(addr, response, sizeof(FrameHeader) + size);
+}
+
+/// <summary>
+/// Tell a panel built with a different schema what ours is
+/// </summary>
+void sendSchema(sockaddr_in* addr, int seq)
+{
+    char response[MaxFrame];
+    FrameHeader* header = (FrameHeader*)response;
+    SchemaEntry* entries = (SchemaEntry*)(response + sizeof(FrameHeader));
+
+    header->seq = seq;
+    header->baseline = 0;
+    header->encoding = ENCODING_SCHEMA;
+    int count = schemaEntries(entries);
+
+    stats.schemas++;
+    sendResponse(addr, response, sizeof(FrameHeader) + count * sizeof(SchemaEntry));
+}
+
+/// <summary>
+/// Check the panel has the same schema and wants the data size we
+/// would send. Tells it our schema or the right size if not.
+/// </summary>
+bool checkRequest(Request* request, sockaddr_in* addr)
+{
+    stats.requests++;
+
+    if (request->layoutHash != layoutHash()) {
+        sendSchema(addr, request->seq);
+        return false;
+    }
+
+    subscribe(request->fields);
+
+    if (request->requestedSize != packedSize) {
+        sendto(sockfd, (char*)&packedSize, sizeof(int), 0, (sockaddr*)addr, sizeof(*addr));
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Answer a data request with full data or a delta against the
+/// baseline the panel says it has.
+/// </summary>
+void receiveRequest(Request* request, sockaddr_in* addr)
+{
+    if (!checkRequest(request, addr)) {
+        return;
+    }
+
+    int baseline = request->wantFullData ? 0 : request->baseline;
+    sendFrame(&history, addr, request->seq, baseline, request->encoding == ENCODING_COMPACT, request->stringHash);
+}
+
+/// <summary>
+/// Returns the stream for a panel or NULL if it has none
+/// </summary>
+Stream* findStream(sockaddr_in* addr)
+{
+    for (int i = 0; i < MaxStreams; i++) {
+        if (streams[i].intervalNs != 0 && streams[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr && streams[i].addr.sin_port == addr->sin_port) {
+            return &streams[i];
+        }
+    }
+
+    return NULL;
+}
+
+void printStream(Stream* stream, const char* action)
+{
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &stream->addr.sin_addr, host, sizeof(host));
+    printf("Stream to %s:%d %s\n", host, ntohs(stream->addr.sin_port), action);
+}
+
+/// <summary>
+/// Start, keep alive or stop pushing frames to a panel. The request
+/// is answered straight away with the next frame in the stream.
+/// </summary>
+void receiveStream(StreamRequest* streamRequest, sockaddr_in* addr)
+{
+    Request* request = &streamRequest->request;
+    Stream* stream = findStream(addr);
+    bool samePanel = (stream != NULL);
+
+    if (streamRequest->rate <= 0) {
+        if (samePanel) {
+            printStream(stream, "stopped");
+            stream->intervalNs = 0;
+        }
+        return;
+    }
+
+    if (!checkRequest(request, addr)) {
+        return;
+    }
+
+    if (!samePanel) {
+        for (int i = 0; i < MaxStreams && !stream; i++) {
+            if (streams[i].intervalNs == 0) {
+                stream = &streams[i];
+            }
+        }
+        if (!stream) {
+            printf("Too many streams, answering as a request\n");
+            sendFrame(&history, addr, request->seq, 0, request->encoding == ENCODING_COMPACT, request->stringHash);
+            return;
+        }
+        stream->addr = *addr;
+        memset(stream->history.seqs, 0, sizeof(stream->history.seqs));
+    }
+    else if (memcmp(stream->fields, request->fields, sizeof(stream->fields)) != 0) {
+        // Panel has nothing of ours it can use as a baseline now
+        memset(stream->history.seqs, 0, sizeof(stream->history.seqs));
+    }
+
+    int rate = (streamRequest->rate > MaxStreamRate) ? MaxStreamRate : streamRequest->rate;
+    if (!samePanel || stream->intervalNs != 1000000000LL / rate) {
+        char action[32];
+        sprintf(action, "at %d fps", rate);
+        printStream(stream, action);
+    }
+
+    long long nowNs = monotonicNs();
+    stream->intervalNs = 1000000000LL / rate;
+    stream->expiryNs = nowNs + StreamTimeoutMs * 1000000LL;
+    stream->compact = (request->encoding == ENCODING_COMPACT);
+    stream->stringHash = request->stringHash;
+    memcpy(stream->fields, request->fields, sizeof(stream->fields));
+
+    int baseline = stream->seq;
+    if (request->wantFullData || !samePanel) {
+        baseline = 0;
+    }
+    else if (streamRequest->resync) {
+        // Panel missed a frame
+        baseline = request->baseline;
+    }
+    int seq = (request->seq > stream->seq) ? request->seq : stream->seq + 1;
+    sendFrame(&stream->history, addr, seq, baseline, stream->compact, stream->stringHash);
+
+    stream->seq = seq;
+    stream->pushedNs = nowNs;
+    stream->nextNs = nowNs + stream->intervalNs;
+}
+
+/// <summary>
+/// Push the next frame to every stream it is due on if anything has
+/// changed (or nothing has been pushed for a while). Returns ms until
+/// the next one is due or -1 if not streaming.
+/// </summary>
+int pushStreams()
+{
+    long long nowNs = monotonicNs();
+    long long nextNs = 0;
+
+    for (int i = 0; i < MaxStreams; i++) {
+        Stream* stream = &streams[i];
+        if (stream->intervalNs == 0) {
+            continue;
+        }
+
+        if (nowNs > stream->expiryNs) {
+            printStream(stream, "timed out");
+            stream->intervalNs = 0;
+            continue;
+        }
+
+        if (nowNs >= stream->nextNs) {
+            stream->nextNs += stream->intervalNs;
+            if (stream->nextNs < nowNs) {
+                stream->nextNs = nowNs + stream->intervalNs;
+            }
+
+            int slot = stream->seq & (HistorySize - 1);
+            bool changed = (stream->history.seqs[slot] != stream->seq || memcmp(&simVars, &stream->history.frames[slot], sizeof(SimVars)) != 0);
+            if (changed || nowNs - stream->pushedNs >= StreamIdleNs) {
+                // Panels can subscribe to different fields
+                subscribe(stream->fields);
+                stream->seq++;
+                sendFrame(&stream->history, &stream->addr, stream->seq, stream->seq - 1, stream->compact, stream->stringHash);
+                stream->pushedNs = nowNs;
+                stats.pushes++;
+            }
+        }
+
+        if (nextNs == 0 || stream->nextNs < nextNs) {
+            nextNs = stream->nextNs;
+        }
+    }
+
+    if (nextNs == 0) {
+        return -1;
+    }
+
+    return (int)((nextNs - nowNs + 999999) / 1000000);
+}
+
+/// <summary>
+/// Decode a delta as the panel would
+/// </summary>
+bool panelDecode(SimVars* target, char* delta, int size, bool compact)
+{
+    if (compact) {
+        return codec.decodeDelta((char*)target, delta, size);
+    }
+
+    return codec.decodeRawDelta((char*)target, delta, size);
+}
+
+/// <summary>
+/// Feed the panel's delta decoders with valid deltas and then with
+/// mutated (flipped, truncated or extended) copies of them. A valid
+/// delta must decode. A bad one must either be rejected without
+/// changing anything or only change subscribed fields, and nothing
+/// outside SimVars may ever be touched. Returns the number of failures.
+/// </summary>
+int fuzz(int runs)
+{
+    const int Guard = 64;
+    struct {
+        char before[Guard];
+        SimVars vars;
+        char after[Guard];
+    } guarded;
+    char guardBytes[Guard];
+    char subscribedBytes[sizeof(SimVars)];
+    char delta[MaxFrame];
+    int failures = 0;
+    int rejected = 0;
+
+    memset(guardBytes, 0xa5, Guard);
+    simVars.connected = 1;
+
+    for (int run = 0; run < runs && failures < 10; run++) {
+        // Random subscription
+        unsigned int fieldBits[FieldWords];
+        for (int word = 0; word < FieldWords; word++) {
+            fieldBits[word] = (rand() & 0xffff) | ((unsigned int)(rand() & 0xffff) << 16);
+        }
+        subscribe(fieldBits);
+
+        memset(subscribedBytes, 0, sizeof(subscribedBytes));
+        for (int field = 0; field < fieldCount; field++) {
+            if (subscribedFields[field / 32] & (1u << (field % 32))) {
+                memset(subscribedBytes + fields[field].offset, 1, fields[field].size);
+            }
+        }
+
+        // Random change from a baseline
+        SimVars baseline = simVars;
+        for (int change = rand() % 8; change >= 0; change--) {
+            randomChange();
+        }
+        if (rand() % 8 == 0) {
+            snprintf(simVars.aircraft, sizeof(simVars.aircraft), "Aircraft %d", rand());
+        }
+
+        bool compact = (rand() % 2 == 0);
+        int size = compact ? codec.encodeDelta(delta, (char*)&simVars, (char*)&baseline) : packDelta(delta, &baseline);
+        if (size == -1) {
+            continue;
+        }
+
+        memset(guarded.before, 0xa5, Guard);
+        memset(guarded.after, 0xa5, Guard);
+        guarded.vars = baseline;
+        if (!panelDecode(&guarded.vars, delta, size, compact)) {
+            printf("Run %d: Valid %s delta of %d bytes rejected\n", run, compact ? "compact" : "raw", size);
+            failures++;
+            continue;
+        }
+        if (!compact) {
+            for (int i = 0; i < (int)sizeof(SimVars); i++) {
+                if (subscribedBytes[i] && ((char*)&guarded.vars)[i] != ((char*)&simVars)[i]) {
+                    printf("Run %d: Raw delta decoded wrongly at offset %d\n", run, i);
+                    failures++;
+                    break;
+                }
+            }
+        }
+
+        // Now break it
+        switch (rand() % 3) {
+        case 0:
+            for (int flips = 1 + rand() % 4; flips > 0 && size > 0; flips--) {
+                delta[rand() % size] ^= 1 << (rand() % 8);
+            }
+            break;
+        case 1:
+            size = (size > 0) ? rand() % size : 0;
+            break;
+        default:
+            for (int extra = 1 + rand() % 40; extra > 0 && size < MaxFrame; extra--) {
+                delta[size++] = rand();
+            }
+            break;
+        }
+
+        SimVars before = guarded.vars;
+        bool accepted = panelDecode(&guarded.vars, delta, size, compact);
+
+        if (memcmp(guarded.before, guardBytes, Guard) != 0 || memcmp(guarded.after, guardBytes, Guard) != 0) {
+            printf("Run %d: Bad %s delta wrote outside SimVars\n", run, compact ? "compact" : "raw");
+            failures++;
+        }
+
+        if (!accepted) {
+            rejected++;
+            if (memcmp(&before, &guarded.vars, sizeof(SimVars)) != 0) {
+                printf("Run %d: Rejected %s delta changed SimVars\n", run, compact ? "compact" : "raw");
+                failures++;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < (int)sizeof(SimVars); i++) {
+            if (!subscribedBytes[i] && ((char*)&guarded.vars)[i] != ((char*)&before)[i]) {
+                printf("Run %d: Bad %s delta wrote to unsubscribed offset %d\n", run, compact ? "compact" : "raw", i);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    printf("Fuzzed %d deltas, %d mutations rejected, %d failures\n", runs, rejected, failures);
+    return failures > 0 ? 1 : 0;
+}
+
+/// <summary>
+/// Time finding the changed slots of a full frame one slot at a time
+/// (what diffSlots falls back to without SIMD) and with diffSlots
+/// itself, on the same frames.
+/// </summary>
+void benchDiff(int runs, SimVars* newVars, SimVars* oldVars, const char* what)
+{
+    unsigned int slotBits[SlotWords];
+    SimVars target;
+    long long found = 0;
+
+    long long startNs = monotonicNs();
+    for (int run = 0; run < runs; run++) {
+        target = *oldVars;
+        memset(slotBits, 0, sizeof(slotBits));
+        if (diffSlotsScalar(slotBits, (char*)newVars, (char*)&target, 0, sizeof(SimVars))) {
+            found += slotBits[0];
+        }
+    }
+    double scalarSecs = (monotonicNs() - startNs) / 1000000000.0;
+
+    startNs = monotonicNs();
+    for (int run = 0; run < runs; run++) {
+        target = *oldVars;
+        memset(slotBits, 0, sizeof(slotBits));
+        if (diffSlots(slotBits, (char*)newVars, (char*)&target, 0, sizeof(SimVars))) {
+            found += slotBits[0];
+        }
+    }
+    double diffSecs = (monotonicNs() - startNs) / 1000000000.0;
+
+    printf("Full frame diff (%s, %d bytes): scalar %.0f ns/frame, %s %.0f ns/frame (%lld)\n",
+        what, (int)sizeof(SimVars), scalarSecs * 1e9 / runs, diffMethod(), diffSecs * 1e9 / runs, found & 1);
+}
+
+/// <summary>
+/// Time the panel's delta decoders on a typical delta (a few radio
+/// fields and the aircraft title changing) for all fields.
+/// </summary>
+void bench(int runs)
+{
+    unsigned int fieldBits[FieldWords];
+    memset(fieldBits, 0xff, sizeof(fieldBits));
+    subscribe(fieldBits);
+
+    SimVars baseline = simVars;
+    simVars.com1Freq = 121.5;
+    simVars.com1Standby = 119.225;
+    simVars.nav1Freq = 113.9;
+    simVars.com1Transmit = 0;
+    simVars.com2Transmit = 1;
+    simVars.transponderCode = 0x7700;
+    simVars.adfFreq = 425;
+    simVars.sbEncoder[0] = 7;
+    strcpy(simVars.aircraft, "Boeing 747-8");
+    int records = 9;
+
+    char delta[MaxFrame];
+    SimVars target;
+    for (int compact = 0; compact < 2; compact++) {
+        int size = compact ? codec.encodeDelta(delta, (char*)&simVars, (char*)&baseline) : packDelta(delta, &baseline);
+
+        long long startNs = monotonicNs();
+        for (int run = 0; run < runs; run++) {
+            if (!panelDecode(&target, delta, size, compact)) {
+                printf("Delta rejected\n");
+                exit(1);
+            }
+        }
+        double secs = (monotonicNs() - startNs) / 1000000000.0;
+
+        printf("%s delta: %d bytes, %.0f deltas/sec, %.0f records/sec, %.1f MB/sec\n",
+            compact ? "Compact" : "Raw", size, runs / secs, runs * records / secs, runs * (double)size / secs / 1000000.0);
+    }
+
+    benchDiff(runs, &baseline, &baseline, "unchanged");
+    benchDiff(runs, &simVars, &baseline, "9 changes");
+}
+
+/// <summary>
+/// Each simulated subscriber has its own socket joined to the hub
+/// group, the same as a panel on another machine.
+/// </summary>
+void openSubscribers()
+{
+    unsigned int allFields[FieldWords];
+    memset(allFields, 0, sizeof(allFields));
+    for (int field = 0; field < fieldCount; field++) {
+        allFields[field / 32] |= 1u << (field % 32);
+    }
+    hubCodec.subscribe(allFields);
+
+    for (int i = 0; i < opts.subscribers; i++) {
+        Subscriber* sub = &subscribers[i];
+        if ((sub->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) == -1) {
+            printf("Failed to create hub subscriber socket\n");
+            exit(1);
+        }
+
+        int reuse = 1;
+        setsockopt(sub->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(HubPort);
+        if (bind(sub->fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            printf("Failed to bind to hub port %d\n", HubPort);
+            exit(1);
+        }
+
+        ip_mreq membership;
+        inet_pton(AF_INET, HubGroup, &membership.imr_multiaddr);
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(sub->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+            printf("Failed to join hub group %s\n", HubGroup);
+            exit(1);
+        }
+    }
+
+    if (opts.subscribers > 0) {
+        printf("Simulating %d hub subscribers on %s:%d\n", opts.subscribers, HubGroup, HubPort);
+    }
+}
+
+/// <summary>
+/// Decode hub frames as a panel would. A delta is only any use if
+/// the subscriber has the frame before it.
+/// </summary>
+void receiveHub(Subscriber* sub)
+{
+    char data[MaxFrame];
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int bytes;
+
+    while ((bytes = recvfrom(sub->fd, data, sizeof(data), 0, (sockaddr*)&from, &fromLen)) > 0) {
+        FrameHeader* header = (FrameHeader*)data;
+        char* payload = data + sizeof(FrameHeader);
+        int size = bytes - (int)sizeof(FrameHeader);
+
+        sub->hub = from;
+        sub->haveHub = true;
+        sub->frames++;
+
+        if (size < 0 || header->encoding != ENCODING_COMPACT) {
+            // Raw frames only happen if nothing can be compacted
+            sub->errors++;
+            continue;
+        }
+
+        if (header->baseline == 0) {
+            SimVars next = sub->vars;
+            if (!hubCodec.decode((char*)&next, payload, size, (char*)&sub->vars)) {
+                sub->errors++;
+                continue;
+            }
+            sub->vars = next;
+            sub->fullFrames++;
+        }
+        else if (header->baseline != sub->seq) {
+            // Missed a frame so wait for the next keyframe
+            sub->gaps++;
+            continue;
+        }
+        else if (!hubCodec.decodeDelta((char*)&sub->vars, payload, size)) {
+            sub->errors++;
+            continue;
+        }
+        else {
+            sub->deltas++;
+        }
+        sub->seq = header->seq;
+    }
+}
+
+/// <summary>
+/// Write an event to the hub publisher, which should relay it here
+/// </summary>
+void writeHub(Subscriber* sub)
+{
+    if (!sub->haveHub) {
+        return;
+    }
+
+    WriteBatch batch;
+    batch.requestedSize = sizeof(WriteData);
+    batch.writeCount = 1;
+    batch.writeData[0].eventId = KEY_ELEV_TRIM_UP;
+    batch.writeData[0].repeat = 1;
+    batch.writeData[0].value = 0;
+
+    int bytes = offsetof(WriteBatch, writeData) + sizeof(WriteData);
+    if (sendto(sub->fd, (char*)&batch, bytes, 0, (sockaddr*)&sub->hub, sizeof(sub->hub)) == bytes) {
+        sub->writes++;
+    }
+}
+
+void hubSummary()
+{
+    Subscriber total;
+    int synced = 0;
+
+    for (int i = 0; i < opts.subscribers; i++) {
+        Subscriber* sub = &subscribers[i];
+        total.frames += sub->frames;
+        total.fullFrames += sub->fullFrames;
+        total.deltas += sub->deltas;
+        total.gaps += sub->gaps;
+        total.errors += sub->errors;
+        total.writes += sub->writes;
+        if (sub->seq != 0 && memcmp(&sub->vars, &subscribers[0].vars, sizeof(SimVars)) == 0) {
+            synced++;
+        }
+        close(sub->fd);
+    }
+
+    printf("Hub subscribers %d (%d in sync), frames %lld, full frames %lld, deltas %lld\n",
+        opts.subscribers, synced, total.frames, total.fullFrames, total.deltas);
+    printf("Gaps %lld, errors %lld, events written %lld\n", total.gaps, total.errors, total.writes);
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:xu:l:j:d:r:w:qF:B:m:")) != -1) {
+        switch (opt) {
+        case 'p': opts.port = atoi(optarg); break;
+        case 's': opts.scriptFile = optarg; break;
+        case 'x': opts.random = true; break;
+        case 'u': opts.simRate = atoi(optarg); break;
+        case 'l': opts.latencyMs = atoi(optarg); break;
+        case 'j': opts.jitterMs = atoi(optarg); break;
+        case 'd': opts.lossPercent = atoi(optarg); break;
+        case 'r': opts.reorderPercent = atoi(optarg); break;
+        case 'w': opts.writeLossPercent = atoi(optarg); break;
+        case 'q': opts.quiet = true; break;
+        case 'F': opts.fuzzRuns = atoi(optarg); break;
+        case 'B': opts.benchRuns = atoi(optarg); break;
+        case 'm': opts.subscribers = atoi(optarg); break;
+        default: usage();
+        }
+    }
+
+    if (opts.simRate <= 0 || opts.subscribers < 0 || opts.subscribers > MaxSubscribers) {
+        usage();
+    }
+
+    fieldCount = fieldTable(fields);
+    simVars.connected = 1;
+    strcpy(simVars.aircraft, "Cessna 152");
+
+    if (opts.fuzzRuns > 0) {
+        return fuzz(opts.fuzzRuns);
+    }
+
+    if (opts.benchRuns > 0) {
+        bench(opts.benchRuns);
+        return 0;
+    }
+
+    if (opts.scriptFile) {
+        loadScript(opts.scriptFile);
+    }
+
+    if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+        printf("Failed to create UDP socket\n");
+        exit(1);
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts.port);
+    if (bind(sockfd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        printf("Failed to bind to port %d\n", opts.port);
+        exit(1);
+    }
+
+    openSubscribers();
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("Stub data link listening on port %d\n", opts.port);
+    fflush(stdout);
+
+    long long startNs = monotonicNs();
+    long long tickNs = 1000000000LL / opts.simRate;
+    long long nextTickNs = startNs + tickNs;
+    long long nextWriteNs = startNs + 1000000000LL;
+    char data[MaxFrame];
+    pollfd pfds[1 + MaxSubscribers];
+
+    pfds[0] = { sockfd, POLLIN, 0 };
+    for (int i = 0; i < opts.subscribers; i++) {
+        pfds[1 + i] = { subscribers[i].fd, POLLIN, 0 };
+    }
+
+    while (!quit) {
+        int timeoutMs = sendQueued();
+        int pushMs = pushStreams();
+        if (pushMs != -1 && (timeoutMs == -1 || pushMs < timeoutMs)) {
+            timeoutMs = pushMs;
+        }
+        int tickMs = (int)((nextTickNs - monotonicNs() + 999999) / 1000000);
+        if (timeoutMs == -1 || tickMs < timeoutMs) {
+            timeoutMs = (tickMs < 0) ? 0 : tickMs;
+        }
+
+        if (poll(pfds, 1 + opts.subscribers, timeoutMs) > 0 && (pfds[0].revents & POLLIN)) {
+            sockaddr_in from;
+            socklen_t fromLen = sizeof(from);
+            int bytes = recvfrom(sockfd, data, sizeof(data), 0, (sockaddr*)&from, &fromLen);
+
+            bool events = (bytes >= (int)offsetof(WriteBatch, writeData) + (int)sizeof(WriteData) && ((int*)data)[0] == sizeof(WriteData));
+            bool reliable = (bytes >= (int)offsetof(ReliableBatch, writes) + (int)sizeof(ReliableWrite) && ((int*)data)[0] == sizeof(ReliableWrite));
+
+            if ((events || reliable) && rand() % 100 < opts.writeLossPercent) {
+                stats.writesDropped++;
+            }
+            else if (events) {
+                receiveEvents(data, bytes);
+            }
+            else if (reliable) {
+                receiveReliable(data, bytes, &from);
+            }
+            else if (bytes == sizeof(Request)) {
+                receiveRequest((Request*)data, &from);
+            }
+            else if (bytes == sizeof(StreamRequest)) {
+                receiveStream((StreamRequest*)data, &from);
+            }
+            else if (bytes > 0) {
+                printf("Ignoring %d byte datagram\n", bytes);
+            }
+            fflush(stdout);
+        }
+
+        for (int i = 0; i < opts.subscribers; i++) {
+            if (pfds[1 + i].revents & POLLIN) {
+                receiveHub(&subscribers[i]);
+            }
+        }
+
+        long long nowNs = monotonicNs();
+        if (opts.subscribers > 0 && nowNs >= nextWriteNs) {
+            writeHub(&subscribers[rand() % opts.subscribers]);
+            nextWriteNs += 1000000000LL / opts.subscribers;
+        }
+        while (nowNs >= nextTickNs) {
+            if (opts.scriptFile) {
+                runScript((nowNs - startNs) / 1000000000.0);
+            }
+            if (opts.random) {
+                randomChange();
+            }
+            nextTickNs += tickNs;
+        }
+    }
+
+    printf("\nRequests %lld, frames pushed %lld, full frames %lld, deltas %lld, bytes sent %lld\n",
+        stats.requests, stats.pushes, stats.fullFrames, stats.deltas, stats.bytesSent);
+    if (stats.schemas > 0) {
+        printf("Schema sent %lld times (panel has a different layout)\n", stats.schemas);
+    }
+    printf("Dropped %lld, reordered %lld, events received %lld\n",
+        stats.dropped, stats.reordered, stats.writes);
+    printf("Event writes dropped %lld, duplicate reliable events %lld\n", stats.writesDropped, stats.duplicates);
+    if (opts.subscribers > 0) {
+        hubSummary();
+    }
+
+    close(sockfd);
+    return 0;
+}